@@ -1,4 +1,5 @@
 #include "bn_fib.h"
+#include "bn_ntt.h"
 
 /* Swap two fbn pointers */
 #define fbn_swap(a, b) \
@@ -7,16 +8,14 @@
         a = b;         \
         b = tmp;       \
     })
-/* Modulo 32 */
-#define MOD32(x) ((x) & ((1U << 5) - 1))
-/* Divide 32 */
-#define DIV32(x) ((x) >> 5)
+/* Modulo FBN_LIMB_BITS */
+#define MODLIMB(x) ((x) & (FBN_LIMB_BITS - 1))
+/* Divide FBN_LIMB_BITS */
+#define DIVLIMB(x) ((x) >> FBN_LIMB_SHIFT)
 /* Round up 4 */
 #define ROUNDUP4(x) (((x) + (1U << 2) - 1) & ~((1U << 2) - 1))
-/* Round up 32 */
-#define ROUNDUP32(x) (((x) + (1U << 5) - 1) & ~((1U << 5) - 1))
-/* Round up 32 and then divide 32 */
-#define DIV_ROUNDUP32(x) DIV32((x) + (1U << 5) - 1)
+/* Round up FBN_LIMB_BITS and then divide FBN_LIMB_BITS */
+#define DIV_ROUNDUPLIMB(x) DIVLIMB((x) + FBN_LIMB_BITS - 1)
 /* Check fbn number is zero or not */
 #define fbn_iszero(x) (!(x)->len)
 /* fbn last element, need to be used without zero fbn */
@@ -25,7 +24,7 @@
  * Assign a value to fbn's n-th num element.
  * @obj: fbn object
  * @n: @n-th element of @obj->num
- * @value: assigning value, only accept 32-bits unsigned integer
+ * @value: assigning value, only accept a limb-sized unsigned integer
  */
 #define fbn_assign(obj, n, value) ((obj)->num[(n)] = (value))
 /* Set one fbn as zero */
@@ -38,7 +37,7 @@
  */
 fbn *fbn_alloc(int cap)
 {
-    if (unlikely(cap <= 0))
+    if (unlikely(cap <= 0 || cap > FBN_MAX_LIMBS))
         goto inval_or_fail_fbnalloc;
     fbn *new = kmalloc(sizeof(fbn), GFP_KERNEL);
     if (unlikely(!new))
@@ -46,11 +45,12 @@ fbn *fbn_alloc(int cap)
 
     /* round up 4 for lazy allocation */
     cap = ROUNDUP4(cap);
-    new->num = kcalloc(cap, sizeof(u32), GFP_KERNEL);
+    new->num = kvcalloc(cap, sizeof(fbn_limb), GFP_KERNEL);
     if (unlikely(!new->num))
         goto fail_num_alloc;
     new->cap = cap;
     new->len = 0;
+    new->arena = NULL;
     return new;
 fail_num_alloc:
     kfree(new);
@@ -67,11 +67,128 @@ int fbn_free(fbn *obj)
 {
     if (unlikely(!obj))
         return -1;
-    kfree(obj->num);
+    if (obj->arena)
+        return 0; /* released with the arena */
+    kvfree(obj->num);
     kfree(obj);
     return 0;
 }
 
+/* Round up to the 16-byte alignment of the arena */
+#define FBN_ARENA_ALIGN(x) (((x) + 15) & ~(size_t) 15)
+
+/*
+ * Allocate @size bytes to an arena.
+ * Return 0 on success and -1 on failure or if @size > FBN_ARENA_MAX.
+ */
+int fbn_arena_init(struct fbn_arena *arena, size_t size)
+{
+    arena->used = 0;
+    if (unlikely(size > FBN_ARENA_MAX)) {
+        arena->size = 0;
+        arena->base = NULL;
+        return -1;
+    }
+    arena->size = FBN_ARENA_ALIGN(size);
+    arena->base = kvmalloc(arena->size, GFP_KERNEL);
+    return likely(arena->base) ? 0 : -1;
+}
+
+/* Release the arena and every fbn carved from it */
+void fbn_arena_destroy(struct fbn_arena *arena)
+{
+    kvfree(arena->base);
+    arena->base = NULL;
+    arena->size = arena->used = 0;
+}
+
+/*
+ * Carve @size bytes from an arena (bump allocation).
+ * Return NULL if the arena is exhausted.
+ */
+static void *fbn_arena_alloc(struct fbn_arena *arena, size_t size)
+{
+    size = FBN_ARENA_ALIGN(size);
+    if (unlikely(size > arena->size - arena->used))
+        return NULL;
+    void *p = arena->base + arena->used;
+    arena->used += size;
+    return p;
+}
+
+/*
+ * Temporaries are freed in LIFO order by restoring the bump pointer, the
+ * helpers below also accept a NULL arena.
+ */
+static inline size_t fbn_arena_mark(const struct fbn_arena *arena)
+{
+    return arena ? arena->used : 0;
+}
+
+static inline void fbn_arena_pop(struct fbn_arena *arena, size_t mark)
+{
+    if (arena)
+        arena->used = mark;
+}
+
+/*
+ * Allocate fbn from an arena, fbn_free() on it is a no-op.
+ * @cap: the length of fbn's num alloc
+ * Return fbn with length round-up4(@cap) and num is all zeros.
+ */
+fbn *fbn_alloc_arena(struct fbn_arena *arena, int cap)
+{
+    if (unlikely(cap <= 0))
+        return NULL;
+    fbn *new = fbn_arena_alloc(arena, sizeof(fbn));
+    if (unlikely(!new))
+        return NULL;
+
+    cap = ROUNDUP4(cap);
+    new->num = fbn_arena_alloc(arena, sizeof(fbn_limb) * cap);
+    if (unlikely(!new->num))
+        return NULL;
+    memset(new->num, 0, sizeof(fbn_limb) * cap);
+    new->cap = cap;
+    new->len = 0;
+    new->arena = arena;
+    return new;
+}
+
+/*
+ * Make sure fbn's num has at least @cap elements, the length is unchanged.
+ * An fbn from an arena moves to a new piece of the arena.
+ * @obj: fbn object
+ * @cap: new capacity of @obj's num
+ * Return 0 on success and -1 on failure.
+ */
+static int fbn_reserve(fbn *obj, int cap)
+{
+    if (likely(cap <= obj->cap))
+        return 0;
+    if (unlikely(cap > FBN_MAX_LIMBS))
+        return -1;
+    int new_cap = ROUNDUP4(cap);
+    fbn_limb *num;
+    if (obj->arena) {
+        num = fbn_arena_alloc(obj->arena, sizeof(fbn_limb) * new_cap);
+        if (unlikely(!num))
+            return -1; /* arena exhausted */
+        memcpy(num, obj->num, sizeof(fbn_limb) * obj->cap);
+    } else {
+        /* kvmalloc: large limb arrays need not be physically contiguous */
+        num = kvmalloc_array(new_cap, sizeof(fbn_limb), GFP_KERNEL);
+        if (unlikely(!num))
+            return -1; /* fail to realloc */
+        memcpy(num, obj->num, sizeof(fbn_limb) * obj->cap);
+        kvfree(obj->num);
+    }
+    memset(num + obj->cap, 0, sizeof(fbn_limb) * (new_cap - obj->cap));
+    obj->num = num;
+    obj->cap = new_cap;
+    return 0;
+}
+
 /*
  * Resize fbn, realloc if needed (lazy alloc).
  * @obj: fbn object
@@ -80,16 +197,9 @@ int fbn_free(fbn *obj)
  */
 static int fbn_resize(fbn *obj, int len)
 {
+    if (unlikely(fbn_reserve(obj, len) < 0))
+        return -1;
     obj->len = len;
-    if (likely(len <= obj->cap))
-        return 0;
-    int new_cap = ROUNDUP4(len);
-    obj->num = krealloc_array(obj->num, new_cap, sizeof(u32), GFP_KERNEL);
-    if (unlikely(!obj->num))
-        return -1; /* fail to realloc */
-    if (new_cap > obj->cap)
-        memset(obj->num + obj->cap, 0, sizeof(u32) * (new_cap - obj->cap));
-    obj->cap = new_cap;
     return 0;
 }
 
@@ -101,7 +211,8 @@ static int fbn_resize(fbn *obj, int len)
 void fbn_set_u32(fbn *obj, u32 value)
 {
     if (value > 0) {
-        fbn_resize(obj, 1);
+        if (unlikely(fbn_resize(obj, 1) < 0))
+            return;
         fbn_assign(obj, 0, value);
     } else {
         fbn_setzero(obj);
@@ -136,16 +247,15 @@ int fbn_copy(fbn *des, const fbn *src)
     int res = fbn_resize(des, src->len);
     if (unlikely(res < 0))
         return -1;
-    memcpy(des->num, src->num, sizeof(u32) * src->len);
+    memcpy(des->num, src->num, sizeof(fbn_limb) * src->len);
     des->len = src->len;
-    des->cap = src->cap;
     return 0;
 }
 
-/* Swap two fbn contents. */
+/* Swap two fbn contents, both must be from the same arena (or kmalloc). */
 static void fbn_swap_content(fbn *a, fbn *b)
 {
-    u32 *num = a->num;
+    fbn_limb *num = a->num;
     a->num = b->num;
     b->num = num;
     int len = a->len;
@@ -161,16 +271,19 @@ static void fbn_swap_content(fbn *a, fbn *b)
 void fbndebug_printhex(const fbn *obj)
 {
     for (int i = obj->cap - 1; i >= 0; --i)
-        pr_info("fibdrv_debug: %d %#010x", i, obj->num[i]);
+        pr_info("fibdrv_debug: %d %#0*llx", i, 2 + FBN_LIMB_BITS / 4,
+                (unsigned long long) obj->num[i]);
     pr_info("fibdrv_debug: - ---------- len %d", obj->len);
 }
 #endif /* _FBN_DEBUG */
 
-/* Print fbn into a string (decimal), need kfree to free this string */
+/* Print fbn into a string (decimal), need kvfree to free this string */
 char *fbn_print(const fbn *obj)
 {
-    size_t slen = (sizeof(int) * 8 * obj->len) / 3 + 2;
-    char *str = kmalloc(slen, GFP_KERNEL), *p = str;
+    size_t slen = ((size_t) FBN_LIMB_BITS * obj->len) / 3 + 2;
+    char *str = kvmalloc(slen, GFP_KERNEL), *p = str;
+    if (unlikely(!str))
+        return NULL;
     memset(str, '0', slen - 1);
     str[slen - 1] = '\0';
     if (unlikely(fbn_iszero(obj))) {
@@ -179,9 +292,10 @@ char *fbn_print(const fbn *obj)
     }
 
     for (int i = obj->len - 1; i >= 0; --i) {
-        for (u32 mask = 1U << 31; mask; mask >>= 1) {
+        for (fbn_limb mask = (fbn_limb) 1 << (FBN_LIMB_BITS - 1); mask;
+             mask >>= 1) {
             int carry = !!(mask & obj->num[i]);
-            for (int j = slen - 2; j >= 0; --j) {
+            for (ssize_t j = slen - 2; j >= 0; --j) {
                 str[j] += str[j] - '0' + carry;
                 carry = (str[j] > '9');
                 if (carry)
@@ -196,24 +310,36 @@ char *fbn_print(const fbn *obj)
     return str;
 }
 
+#if FBN_LIMB_BITS == 64
+/* (high * 2^64 + low) = q * d + r, be aware of overflow of q */
+#define divlimb(high, low, d, q, r) \
+    __asm__("divq %4" : "=a"(q), "=d"(r) : "0"(low), "1"(high), "rm"(d))
+/* the largest power of 10^9 fitting in a limb */
+#define FBN_DECBASE 1000000000000000000ULL
+#define FBN_DECBASE_DIGITS 18
+#else
 /* (high * 2^32 + low) = q * d + r, be aware of overflow of q */
-#define divl(high, low, d, q, r) \
+#define divlimb(high, low, d, q, r) \
     __asm__("divl %4" : "=a"(q), "=d"(r) : "0"(low), "1"(high), "rm"(d))
+/* the largest power of 10^9 fitting in a limb */
+#define FBN_DECBASE 1000000000U
+#define FBN_DECBASE_DIGITS 9
+#endif
 
 /*
- * Divide obj by 10^9.
- * @obj: fbn object which is dividend in the beginning and quotient in the end
+ * Divide num by FBN_DECBASE (10^9 for 32-bit limbs, 10^18 for 64-bit limbs).
+ * @num: @len limbs which are dividend in the beginning and quotient in the end
  * Return the remainder.
  */
-static u32 fbn_divten9(fbn *obj)
+static fbn_limb fbn_divdecbase(fbn_limb *num, int len)
 {
-    u32 high_r = 0, divisor = 1000000000U;
+    fbn_limb high_r = 0, divisor = FBN_DECBASE;
     /* start from the leading non-zero element */
-    u32 *nump = obj->num + obj->len - 1;
+    fbn_limb *nump = num + len - 1;
 
-    for (int i = obj->len - 1; i >= 0; --i) {
-        u32 cur = *nump, q, r;
-        divl(high_r, cur, divisor, q, r);
+    for (int i = len - 1; i >= 0; --i) {
+        fbn_limb cur = *nump, q, r;
+        divlimb(high_r, cur, divisor, q, r);
         *nump = q; /* store the quotient */
 
         high_r = r; /* update the remainder */
@@ -271,36 +397,57 @@ static char *put_dec(char *end, u32 n)
     return p;
 }
 
-/* Print fbn into string (version 1), need kfree to free the string */
-char *fbn_printv1(const fbn *obj)
+/* Print a remainder of fbn_divdecbase() (9 or 18 digits) ending at @end */
+static char *put_dec_limb(char *end, fbn_limb n)
+{
+#if FBN_LIMB_BITS == 64
+    end = put_dec(end, n % 1000000000U);
+    n /= 1000000000U;
+#endif
+    return put_dec(end, n);
+}
+
+static char *fbn_printv1_dc(const fbn *obj, struct fbn_arena *arena);
+
+/*
+ * Print fbn into string (version 1).
+ * @arena: where the string and the temporary come from, NULL for kvmalloc
+ */
+static char *__fbn_printv1(const fbn *obj, struct fbn_arena *arena)
 {
     if (unlikely(fbn_iszero(obj))) {
-        char *str = kmalloc(2, GFP_KERNEL);
+        char *str = arena ? fbn_arena_alloc(arena, 2) : kvmalloc(2, GFP_KERNEL);
+        if (unlikely(!str))
+            return NULL;
         str[0] = '0';
         str[1] = '\0';
         return str;
     }
+    if (obj->len >= fbn_dec_dc_threshold)
+        return fbn_printv1_dc(obj, arena);
 
-    fbn *obj2 = fbn_alloc(obj->len); /* alloc fbn */
+    fbn *obj2 = arena ? fbn_alloc_arena(arena, obj->len)
+                      : fbn_alloc(obj->len); /* alloc fbn */
     if (unlikely(!obj2))
         goto fail_to_alloc;
     int res = fbn_copy(obj2, obj); /* copy fbn */
     if (unlikely(res))
         goto fail_to_copy_or_creatstr;
     /* almost 10 digits per 32 bits */
-    size_t str_len = (obj2->len + 1) * 10;
-    char *str = kmalloc(str_len, GFP_KERNEL); /* alloc string */
+    size_t str_len = (size_t) (obj2->len + 1) * (FBN_LIMB_BITS / 32) * 10;
+    char *str = arena ? fbn_arena_alloc(arena, str_len)
+                      : kvmalloc(str_len, GFP_KERNEL); /* alloc string */
     if (unlikely(!str))
         goto fail_to_copy_or_creatstr;
     str[str_len - 1] = '\0';
-    char *str_end = str + str_len - 1, *head = str_end - 1;
+    char *str_end = str + str_len - 1, *head = str_end;
 
     /* short division, print decimal string */
     do {
-        /* divided by 10^9, obj2 will become the quotient */
-        u32 r_ten9 = fbn_divten9(obj2);
-        /* print r_ten9 in str (9 digits) */
-        head = put_dec(head, r_ten9);
+        /* divided by FBN_DECBASE, obj2 will become the quotient */
+        fbn_limb r_dec = fbn_divdecbase(obj2->num, obj2->len);
+        /* print r_dec in str (9 or 18 digits) */
+        head = put_dec_limb(head, r_dec);
 
         /* decrease when a new leading zero element appears */
         obj2->len -= !fbn_lastelmt(obj2);
@@ -319,56 +466,174 @@ fail_to_alloc:
     return NULL;
 }
 
+/* Print fbn into string (version 1), need kvfree to free the string */
+char *fbn_printv1(const fbn *obj)
+{
+    return __fbn_printv1(obj, NULL);
+}
+
+/* Print fbn into string (version 1), the string is carved from @arena */
+char *fbn_printv1_arena(const fbn *obj, struct fbn_arena *arena)
+{
+    return __fbn_printv1(obj, arena);
+}
+
+/*
+ * Print fbn in radix FBN_DECBASE into string, a limb is just 9 or 18 digits.
+ * @arena: where the string comes from, NULL for kvmalloc
+ */
+static char *__fbn_print_dec(const fbn *obj, struct fbn_arena *arena)
+{
+    size_t str_len = (size_t) obj->len * FBN_DECBASE_DIGITS + 2;
+    char *str = arena ? fbn_arena_alloc(arena, str_len)
+                      : kvmalloc(str_len, GFP_KERNEL); /* alloc string */
+    if (unlikely(!str))
+        return NULL;
+    str[str_len - 1] = '\0';
+    char *str_end = str + str_len - 1, *head = str_end;
+
+    for (int i = 0; i < obj->len; ++i)
+        head = put_dec_limb(head, obj->num[i]);
+    if (fbn_iszero(obj))
+        *--head = '0';
+
+    /* strip off the leading 0's */
+    while (head < str_end - 1 && *head == '0')
+        ++head;
+    memmove(str, head, strlen(head) + 1);
+    return str;
+}
+
+/*
+ * Print fbn in radix FBN_DECBASE into string, need kvfree to free the string
+ */
+char *fbn_print_dec(const fbn *obj)
+{
+    return __fbn_print_dec(obj, NULL);
+}
+
+/* Print fbn in radix FBN_DECBASE into string carved from @arena */
+char *fbn_print_dec_arena(const fbn *obj, struct fbn_arena *arena)
+{
+    return __fbn_print_dec(obj, arena);
+}
+
+/* Length of @obj without leading zero limbs */
+static int fbn_toplen(const fbn *obj)
+{
+    int len = obj->len;
+    while (len && !obj->num[len - 1])
+        --len;
+    return len;
+}
+
+/* Bytes of @obj in raw format, zero takes one byte */
+size_t fbn_raw_size(const fbn *obj)
+{
+    int len = fbn_toplen(obj);
+    if (unlikely(!len))
+        return 1;
+    return (size_t) (len - 1) * sizeof(fbn_limb) +
+           (fbn_fls(obj->num[len - 1]) + 7) / 8;
+}
+
+/* Store @obj into @buf as little-endian bytes, fbn_raw_size() of them */
+void fbn_to_raw(const fbn *obj, u8 *buf)
+{
+    size_t size = fbn_raw_size(obj);
+
+    if (unlikely(!fbn_toplen(obj))) {
+        buf[0] = 0;
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        fbn_limb limb = obj->num[i / sizeof(fbn_limb)];
+        buf[i] = limb >> (8 * (i % sizeof(fbn_limb)));
+    }
+}
+
+/* Bytes of @obj in hex string, including the terminating '\0' */
+size_t fbn_hex_size(const fbn *obj)
+{
+    int len = fbn_toplen(obj);
+    if (unlikely(!len))
+        return 2;
+    return (size_t) (len - 1) * (FBN_LIMB_BITS / 4) +
+           (fbn_fls(obj->num[len - 1]) + 3) / 4 + 1;
+}
+
+/* Print @obj into @buf as lowercase hex string, fbn_hex_size() bytes */
+void fbn_to_hex(const fbn *obj, char *buf)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t ndigit = fbn_hex_size(obj) - 1;
+
+    buf[ndigit] = '\0';
+    if (unlikely(!fbn_toplen(obj))) {
+        buf[0] = '0';
+        return;
+    }
+    for (size_t i = 0; i < ndigit; ++i) {
+        size_t d = ndigit - 1 - i; /* nibble index from the lowest */
+        fbn_limb limb = obj->num[d / (FBN_LIMB_BITS / 4)];
+        buf[i] = hex[(limb >> (4 * (d % (FBN_LIMB_BITS / 4)))) & 0xf];
+    }
+}
+
 /*
  * Left-shift under 31 bits: b = a << k. a <<= k is also acceptable.
  * @b: fbn object to store the result
  * @a: fbn object to be shifted
- * @k: shift @k bits, k %= 32
+ * @k: shift @k bits, 0 <= k < 32
+ * Return 0 on success and -ENOMEM on failure.
  */
-void fbn_lshift31(fbn *b, fbn *a, int k)
+int fbn_lshift31(fbn *b, fbn *a, int k)
 {
     /* shift 0 bit or a is zero fbn */
-    if (unlikely(!k || fbn_iszero(a))) {
-        fbn_copy(b, a);
-        return;
-    }
-    /* take modulus 32 and resize b */
-    int new_len = a->len - 1 + DIV_ROUNDUP32(fls(fbn_lastelmt(a)) + MOD32(k));
-    fbn_resize(b, new_len);
+    if (unlikely(!k || fbn_iszero(a)))
+        return fbn_copy(b, a) ? -ENOMEM : 0;
+    /* take modulus FBN_LIMB_BITS and resize b */
+    int new_len =
+        a->len - 1 + DIV_ROUNDUPLIMB(fbn_fls(fbn_lastelmt(a)) + MODLIMB(k));
+    if (unlikely(fbn_resize(b, new_len) < 0))
+        return -ENOMEM;
 
     /* shift and combine carry bits */
-    u64 bcabinet = 0;
+    fbn_dlimb bcabinet = 0;
     for (int i = 0; i < a->len; ++i) {
-        bcabinet = (u64) a->num[i] << k | bcabinet;
+        bcabinet = (fbn_dlimb) a->num[i] << k | bcabinet;
         b->num[i] = bcabinet;
-        bcabinet >>= 32;
+        bcabinet >>= FBN_LIMB_BITS;
     }
     /* remaining part */
     if (bcabinet)  // TODO: TEST [likely or unlikely] in fast doubling method
         fbn_lastelmt(b) = bcabinet;
+    return 0;
 }
 
 /*
  * Left-shift (general): obj->num <<= k
  * @obj: fbn object, num cannot be 0
  * @k: shift @k bits (no limit)
+ * Return 0 on success and -ENOMEM on failure.
  */
-void fbn_lshift(fbn *obj, int k)
+int fbn_lshift(fbn *obj, int k)
 {
     if (unlikely(!k || fbn_iszero(obj)))
-        return;
-    int shift_bit = MOD32(k);
-    int shift_elmt = DIV32(k);
-    int new_elmt = DIV32(k + fls(fbn_lastelmt(obj)) - 1);
-    fbn_resize(obj, obj->len + new_elmt);
+        return 0;
+    int shift_bit = MODLIMB(k);
+    int shift_elmt = DIVLIMB(k);
+    int new_elmt = DIVLIMB(k + fbn_fls(fbn_lastelmt(obj)) - 1);
+    if (unlikely(fbn_resize(obj, obj->len + new_elmt) < 0))
+        return -ENOMEM;
 
     /*               0     1       (len - 1)
      * obj->num = | xxx | xxx | ... | xxx |
      *               ^     ^  ^  ^     ^
      *              low     middle    high
      */
-    int shift_back = 32 - shift_bit;
-    u32 mask = -(1U << shift_back);
+    int shift_back = FBN_LIMB_BITS - shift_bit;
+    fbn_limb mask = -((fbn_limb) 1 << shift_back);
     /* high part */
     int i = obj->len - 1;
     if (new_elmt > shift_elmt) {
@@ -388,233 +653,2587 @@ void fbn_lshift(fbn *obj, int k)
     /* remaining zeros part */
     for (; i >= 0; --i)
         obj->num[i] = 0;
+    return 0;
 }
 
-/* c = a + b, addition assignment (a += b) is also acceptable */
-void fbn_add(fbn *c, fbn *a, fbn *b)
+/*
+ * c = a + b, addition assignment (a += b) is also acceptable.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_add(fbn *c, fbn *a, fbn *b)
 {
     /* trivial case: a or b is zero */
     int a_iszero = fbn_iszero(a);
-    if (unlikely(a_iszero || fbn_iszero(b))) {
-        if (a_iszero)
-            fbn_copy(c, b);
-        else
-            fbn_copy(c, a);
-        return;
-    }
+    if (unlikely(a_iszero || fbn_iszero(b)))
+        return fbn_copy(c, a_iszero ? b : a) ? -ENOMEM : 0;
 
     /* a->num is always the longest one */
     if (a->len < b->len)
         fbn_swap(a, b);
     int b_len = b->len;
-    fbn_resize(c, a->len);
+    if (unlikely(fbn_resize(c, a->len) < 0))
+        return -ENOMEM;
 
     /* addition operation (same length part) */
     int i;
-    u64 bcabinet = 0;
+    fbn_dlimb bcabinet = 0;
     for (i = 0; i < b_len; ++i) {
-        bcabinet += (u64) a->num[i] + b->num[i];
+        bcabinet += (fbn_dlimb) a->num[i] + b->num[i];
         c->num[i] = bcabinet;
-        bcabinet >>= 32;
+        bcabinet >>= FBN_LIMB_BITS;
     }
     /* addition operation (remaining part) */
     for (; i < a->len; ++i) {
-        bcabinet += (u64) a->num[i];
+        bcabinet += (fbn_dlimb) a->num[i];
         c->num[i] = bcabinet;
-        bcabinet >>= 32;
+        bcabinet >>= FBN_LIMB_BITS;
     }
     /* if the carry is still remained */
     if (unlikely(bcabinet)) {
-        fbn_resize(c, a->len + 1);
+        if (unlikely(fbn_resize(c, a->len + 1) < 0))
+            return -ENOMEM;
         fbn_lastelmt(c) = bcabinet; /* bcabinet = 1 */
     }
+    return 0;
 }
 
-/* c = a - b, where a >= b. a -= b is also acceptable */
-void fbn_sub(fbn *c, fbn *a, fbn *b)
+/*
+ * c = a - b, where a >= b. a -= b is also acceptable.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_sub(fbn *c, fbn *a, fbn *b)
 {
     /* trivial case: a or b is zero */
     int a_iszero = fbn_iszero(a);
     if (unlikely(a_iszero || fbn_iszero(b))) {
-        if (a_iszero)
+        if (a_iszero) {
             fbn_set_u32(c, 0);
-        else
-            fbn_copy(c, a);
-        return;
+            return 0;
+        }
+        return fbn_copy(c, a) ? -ENOMEM : 0;
     }
-    fbn_resize(c, a->len);
+    if (unlikely(fbn_resize(c, a->len) < 0))
+        return -ENOMEM;
 
     int i;
-    u32 borrow = 0;
-    u64 subtrahend;
+    fbn_limb borrow = 0;
+    fbn_dlimb subtrahend;
     for (i = 0; i < b->len; ++i) {
-        subtrahend = (u64) b->num[i] + borrow;
+        subtrahend = (fbn_dlimb) b->num[i] + borrow;
         borrow = subtrahend > a->num[i];
-        c->num[i] = a->num[i] - (u32) subtrahend;
+        c->num[i] = a->num[i] - (fbn_limb) subtrahend;
     }
     for (; i < a->len; ++i) {
-        subtrahend = (u64) borrow;
+        subtrahend = (fbn_dlimb) borrow;
         borrow = subtrahend > a->num[i];
-        c->num[i] = a->num[i] - (u32) subtrahend;
+        c->num[i] = a->num[i] - (fbn_limb) subtrahend;
     }
     /* truncate the leading zero elements */
     fbn_trunclz(c);
+    return 0;
 }
 
-/* c = a * b (long multiplication). a *= b is also acceptable */
-void fbn_mul(fbn *c, fbn *a, fbn *b)
+/*
+ * Low-level limb array kernels. They work on plain limb arrays (not fbn), the
+ * lengths are given by the caller and the results are never truncated.
+ */
+
+/* r = a + b (n limbs), r can be a or b. Return the carry. */
+static fbn_limb __fbn_add_n(fbn_limb *r,
+                            const fbn_limb *a,
+                            const fbn_limb *b,
+                            int n)
 {
-    /* trivial case */
-    if (unlikely(fbn_iszero(a) || fbn_iszero(b))) {
-        fbn_set_u32(c, 0); /* c = 0 */
-        return;
+    fbn_dlimb bcabinet = 0;
+    for (int i = 0; i < n; ++i) {
+        bcabinet += (fbn_dlimb) a[i] + b[i];
+        r[i] = bcabinet;
+        bcabinet >>= FBN_LIMB_BITS;
+    }
+    return bcabinet;
+}
+
+/* r = a - b (n limbs), r can be a or b. Return the borrow. */
+static fbn_limb __fbn_sub_n(fbn_limb *r,
+                            const fbn_limb *a,
+                            const fbn_limb *b,
+                            int n)
+{
+    fbn_limb borrow = 0;
+    for (int i = 0; i < n; ++i) {
+        fbn_dlimb subtrahend = (fbn_dlimb) b[i] + borrow;
+        borrow = subtrahend > a[i];
+        r[i] = a[i] - (fbn_limb) subtrahend;
     }
+    return borrow;
+}
 
-    int new_len = a->len + b->len - 2 +
-                  DIV_ROUNDUP32(fls(fbn_lastelmt(a)) + fls(fbn_lastelmt(b)));
-    fbn *pseudo_c = fbn_alloc(new_len); /* need an all zero array */
-    fbn_resize(pseudo_c, new_len);
-
-    /* long multiplication */
-    for (int offset = 0; offset < b->len; ++offset) {
-        int pc_idx = 0; /* 0 for suppressing cppcheck */
-        u64 bcabinet = 0;
-        /* c += a * (b->num[offset]) */
-        for (int i = 0; i < a->len; ++i) {
-            pc_idx = i + offset;
-            bcabinet +=
-                (u64) a->num[i] * b->num[offset] + pseudo_c->num[pc_idx];
-            pseudo_c->num[pc_idx] = bcabinet;
-            bcabinet >>= 32;
-        }
-        pseudo_c->num[pc_idx + 1] = bcabinet; /* maybe it's 0 */
+/* r += carry, r has n limbs. Return the carry out of r[n - 1]. */
+static fbn_limb __fbn_add_1(fbn_limb *r, int n, fbn_limb carry)
+{
+    for (int i = 0; carry && i < n; ++i) {
+        r[i] += carry;
+        carry = r[i] < carry;
+    }
+    return carry;
+}
+
+/* r -= borrow, r has n limbs. Return the borrow out of r[n - 1]. */
+static fbn_limb __fbn_sub_1(fbn_limb *r, int n, fbn_limb borrow)
+{
+    for (int i = 0; borrow && i < n; ++i) {
+        fbn_limb old = r[i];
+        r[i] -= borrow;
+        borrow = r[i] > old;
+    }
+    return borrow;
+}
+
+/* r = a + b, where an >= bn, r can be a. Return the carry. */
+static fbn_limb __fbn_add(fbn_limb *r,
+                          const fbn_limb *a,
+                          int an,
+                          const fbn_limb *b,
+                          int bn)
+{
+    fbn_limb carry = __fbn_add_n(r, a, b, bn);
+    if (r != a)
+        memcpy(r + bn, a + bn, sizeof(fbn_limb) * (an - bn));
+    return __fbn_add_1(r + bn, an - bn, carry);
+}
+
+/* r = a - b, where an >= bn, r can be a. Return the borrow. */
+static fbn_limb __fbn_sub(fbn_limb *r,
+                          const fbn_limb *a,
+                          int an,
+                          const fbn_limb *b,
+                          int bn)
+{
+    fbn_limb borrow = __fbn_sub_n(r, a, b, bn);
+    if (r != a)
+        memcpy(r + bn, a + bn, sizeof(fbn_limb) * (an - bn));
+    return __fbn_sub_1(r + bn, an - bn, borrow);
+}
+
+/* r = a * b, where a has n limbs. Return the most significant limb. */
+static fbn_limb __fbn_mul_1(fbn_limb *r, const fbn_limb *a, int n, fbn_limb b)
+{
+    fbn_dlimb bcabinet = 0;
+    for (int i = 0; i < n; ++i) {
+        bcabinet += (fbn_dlimb) a[i] * b;
+        r[i] = bcabinet;
+        bcabinet >>= FBN_LIMB_BITS;
     }
-    /* truncate the leading zero element */
-    if (!fbn_lastelmt(pseudo_c))
-        fbn_resize(pseudo_c, new_len - 1);
+    return bcabinet;
+}
 
-    /* pass the content to c */
-    fbn_swap_content(pseudo_c, c);
-    fbn_free(pseudo_c);
+/* r += a * b, where a has n limbs. Return the most significant limb. */
+static fbn_limb __fbn_addmul_1(fbn_limb *r,
+                               const fbn_limb *a,
+                               int n,
+                               fbn_limb b)
+{
+    fbn_dlimb bcabinet = 0;
+    for (int i = 0; i < n; ++i) {
+        bcabinet += (fbn_dlimb) a[i] * b + r[i];
+        r[i] = bcabinet;
+        bcabinet >>= FBN_LIMB_BITS;
+    }
+    return bcabinet;
 }
 
 /*
- * Calculate the nth Fibonacci number with definition.
- * @des: fbn object to store @n-th Fibonacci number
- * @n: @n-th Fibonacci number
+ * Set @r to |a - b| (n limbs).
+ * Return 1 if a < b, otherwise 0.
  */
-void fbn_fib_defi(fbn *des, int n)
+static int __fbn_absdiff_n(fbn_limb *r,
+                           const fbn_limb *a,
+                           const fbn_limb *b,
+                           int n)
 {
-    /* trivial case */
-    if (unlikely(n <= 2)) {
-        if (n > 0)
-            fbn_set_u32(des, 1); /* des = 1 */
-        else
-            fbn_set_u32(des, 0); /* des = 0 */
-        return;
+    int i = n - 1;
+    for (; i >= 0 && a[i] == b[i]; --i)
+        r[i] = 0;
+    if (i < 0)
+        return 0;
+    if (a[i] > b[i]) {
+        __fbn_sub_n(r, a, b, i + 1);
+        return 0;
     }
+    __fbn_sub_n(r, b, a, i + 1);
+    return 1;
+}
 
-    /* Fibonacci definition */
-    fbn *arr[2];
-    arr[0] = fbn_alloc(1);
-    arr[1] = fbn_alloc(1);
-    fbn_set_u32(arr[0], 1); /* arr[0] = 1 (F_1) */
-    fbn_set_u32(arr[1], 1); /* arr[1] = 1 (F_2) */
-    for (int i = 3; i <= n; ++i)
-        fbn_add(arr[i & 1], arr[i & 1], arr[(i - 1) & 1]);
+/* r = -r (n limbs, two's complement) */
+static void __fbn_neg_n(fbn_limb *r, int n)
+{
+    for (int i = 0; i < n; ++i)
+        r[i] = ~r[i];
+    __fbn_add_1(r, n, 1);
+}
 
-    fbn_swap_content(des, arr[n & 1]);
-    fbn_free(arr[0]);
-    fbn_free(arr[1]);
+/* r = a >> 1 (n limbs), r can be a */
+static void __fbn_rshift1_n(fbn_limb *r, const fbn_limb *a, int n)
+{
+    for (int i = 0; i < n - 1; ++i)
+        r[i] = a[i] >> 1 | a[i + 1] << (FBN_LIMB_BITS - 1);
+    r[n - 1] = a[n - 1] >> 1;
 }
 
 /*
- * Calculate the nth Fibonacci number with fast doubling method.
- * @des: fbn object to store @n-th Fibonacci number
- * @n: @n-th Fibonacci number
+ * r = a / 3 (n limbs), where a must be a multiple of 3. r can be a.
+ * Exact division: multiply every limb by the inverse of 3 modulo 2^limbbits
+ * and carry the high part of (quotient limb * 3) as a borrow.
  */
-void fbn_fib_fastdoubling(fbn *des, int n)
+static void __fbn_divexact3_n(fbn_limb *r, const fbn_limb *a, int n)
 {
-    /* trivial case */
-    if (unlikely(n <= 2)) {
-        if (n > 0)
-            fbn_set_u32(des, 1); /* des = 1 */
-        else
-            fbn_set_u32(des, 0); /* des = 0 */
-        return;
+    const fbn_limb inv3 = (fbn_limb) -1 / 3 * 2 + 1; /* 3 * inv3 = 1 */
+    fbn_limb borrow = 0;
+    for (int i = 0; i < n; ++i) {
+        fbn_limb x = a[i], c = x < borrow;
+        fbn_limb q = (x - borrow) * inv3;
+        r[i] = q;
+        borrow = c + (fbn_limb) (((fbn_dlimb) q * 3) >> FBN_LIMB_BITS);
     }
+}
 
-    /* fast doubling method */
-    u32 mask = 1U << (fls((u32) n) - 1);
-    fbn *a = des; /* a will be the result */
-    fbn *b = fbn_alloc(1);
-    fbn *tmp = fbn_alloc(1);
-    fbn_set_u32(a, 0); /* a = 0 */
-    fbn_set_u32(b, 1); /* b = 1 */
-    while (mask) {
-        /* times 2 */
-        fbn_lshift31(tmp, b, 1);  /* tmp = ((b << 1) */
-        fbn_sub(tmp, tmp, a);     /*        - a) */
-        fbn_mul(tmp, tmp, a);     /*        * a */
-        fbn_mul(a, a, a);         /* a^2 */
-        fbn_mul(b, b, b);         /* b^2 */
-        fbn_add(b, b, a);         /* b = a^2 + b^2 */
-        fbn_swap_content(a, tmp); /* a <-> tmp */
+/*
+ * r = a * b (long multiplication), r has (an + bn) limbs.
+ * @r cannot overlap @a or @b.
+ */
+static void __fbn_mul_basecase(fbn_limb *r,
+                               const fbn_limb *a,
+                               int an,
+                               const fbn_limb *b,
+                               int bn)
+{
+    r[an] = __fbn_mul_1(r, a, an, b[0]);
+    for (int offset = 1; offset < bn; ++offset)
+        r[an + offset] = __fbn_addmul_1(r + offset, a, an, b[offset]);
+}
 
-        /* plus 1 */
-        if (mask & n) {
-            fbn_swap_content(a, b); /* a <-> b */
-            fbn_add(b, b, a);       /* b += a */
-        }
-        mask >>= 1;
-    }
+/* The smallest operand length that Karatsuba can split */
+#define FBN_KARA_MIN 4
+/* The smallest operand length that Toom-3 can split */
+#define FBN_TOOM3_MIN 16
+/* Limb threshold to switch from long multiplication to Karatsuba */
+int fbn_karatsuba_threshold = FBN_KARATSUBA_THRESHOLD;
+/* Limb threshold to switch from basecase squaring to Karatsuba squaring */
+int fbn_karatsuba_sqr_threshold = FBN_KARATSUBA_SQR_THRESHOLD;
+/* Limb threshold to switch from Karatsuba to Toom-3 */
+int fbn_toom3_threshold = FBN_TOOM3_THRESHOLD;
+/* Limb threshold to switch from Karatsuba squaring to Toom-3 squaring */
+int fbn_toom3_sqr_threshold = FBN_TOOM3_SQR_THRESHOLD;
 
-    fbn_free(b);
-    fbn_free(tmp);
+#ifdef FBN_HAVE_NTT
+/* Limb threshold to switch to NTT */
+int fbn_ntt_threshold = FBN_NTT_THRESHOLD;
+int fbn_mul_workers = FBN_MUL_WORKERS;
+int fbn_mul_grain = FBN_MUL_GRAIN;
+
+/* Is n-limb operand worth multiplying by NTT? */
+static inline int fbn_ntt_worth(int n)
+{
+    return n >= fbn_ntt_threshold;
+}
+#else
+#define fbn_ntt_worth(n) 0
+#define fbn_ntt_scratch(an, bn) 0
+#define fbn_ntt_mul(r, a, an, b, bn, scratch) ((void) 0)
+#define fbn_ntt_sqr(r, a, n, scratch) ((void) 0)
+#endif /* FBN_HAVE_NTT */
+
+/* Is n-limb operand worth splitting by Karatsuba? */
+static inline int fbn_kara_worth(int n)
+{
+    return n >= fbn_karatsuba_threshold && n >= FBN_KARA_MIN;
 }
 
+/* Is n-limb operand worth splitting by Karatsuba squaring? */
+static inline int fbn_kara_sqr_worth(int n)
+{
+    return n >= fbn_karatsuba_sqr_threshold && n >= FBN_KARA_MIN;
+}
+
+/* Is n-limb operand worth splitting by Toom-3? */
+static inline int fbn_toom3_worth(int n)
+{
+    return n >= fbn_toom3_threshold && n >= FBN_TOOM3_MIN;
+}
+
+/* Is n-limb operand worth splitting by Toom-3 squaring? */
+static inline int fbn_toom3_sqr_worth(int n)
+{
+    return n >= fbn_toom3_sqr_threshold && n >= FBN_TOOM3_MIN;
+}
+
+static void __fbn_mul_n(fbn_limb *r,
+                        const fbn_limb *a,
+                        const fbn_limb *b,
+                        int n,
+                        fbn_limb *scratch);
+static void __fbn_sqr_n(fbn_limb *r,
+                        const fbn_limb *a,
+                        int n,
+                        fbn_limb *scratch);
+
 /*
- * Calculate the nth Fibonacci number with fast doubling method.
- * Version 1: without subtraction
- * @des: fbn object to store @n-th Fibonacci number
- * @n: @n-th Fibonacci number
+ * r = a * b by Karatsuba, a and b both have n limbs, r has 2n limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ *
+ *   a = a1 * B^l + a0, b = b1 * B^l + b0, where l = ceil(n / 2)
+ *   a * b = a1b1 * B^2l + (a0b0 + a1b1 - (a0 - a1)(b0 - b1)) * B^l + a0b0
  */
-void fbn_fib_fastdoublingv1(fbn *des, int n)
+static void __fbn_mul_kara(fbn_limb *r,
+                           const fbn_limb *a,
+                           const fbn_limb *b,
+                           int n,
+                           fbn_limb *scratch)
 {
-    /* trivial case */
-    if (unlikely(n <= 2)) {
-        if (n > 0)
-            fbn_set_u32(des, 1); /* des = 1 */
-        else
-            fbn_set_u32(des, 0); /* des = 0 */
-        return;
+    int l = n - (n >> 1), h = n >> 1;
+    fbn_limb *d = scratch, *da = scratch + 2 * l, *db = scratch + 3 * l;
+    fbn_limb *next = scratch + 4 * l;
+
+    /* da = |a0 - a1|, db = |b0 - b1|, the high halves may be 1 limb shorter */
+    memcpy(da, a + l, sizeof(fbn_limb) * h);
+    memcpy(db, b + l, sizeof(fbn_limb) * h);
+    if (l > h)
+        da[h] = 0, db[h] = 0;
+    int neg = __fbn_absdiff_n(da, a, da, l) ^ __fbn_absdiff_n(db, b, db, l);
+
+    __fbn_mul_n(d, da, db, l, next);               /* d = da * db */
+    __fbn_mul_n(r, a, b, l, next);                 /* r_low = a0b0 */
+    __fbn_mul_n(r + 2 * l, a + l, b + l, h, next); /* r_high = a1b1 */
+
+    /* middle term: d = a0b0 + a1b1 -/+ d, carry from the (2l)-th limb */
+    long carry;
+    if (neg)
+        carry = __fbn_add_n(d, d, r, 2 * l);
+    else
+        carry = -(long) __fbn_sub_n(d, r, d, 2 * l);
+    fbn_limb carry_h = __fbn_add_n(d, d, r + 2 * l, 2 * h);
+    carry += __fbn_add_1(d + 2 * h, 2 * (l - h), carry_h);
+
+    /* r += d * B^l, the middle term is non-negative so is the carry */
+    carry += __fbn_add_n(r + l, r + l, d, 2 * l);
+    __fbn_add_1(r + 3 * l, 2 * n - 3 * l, carry);
+}
+
+/*
+ * Interpolate the Toom-3 coefficients and add them into r (2n limbs).
+ * @r: a(0)b(0) in r[0 .. 2k), a(inf)b(inf) in r[4k .. 2n), zeros in between
+ * @v1, @vm1, @v2: a(x)b(x) at x = 1, -1, 2 in (2k + 2)-limb two's complement,
+ *                 destroyed after interpolation
+ *
+ * Let c(x) = c4 x^4 + c3 x^3 + c2 x^2 + c1 x + c0, every step below keeps a
+ * non-negative value, so the divisions by 2 and 3 are exact on limbs.
+ */
+static void __fbn_toom3_interp(fbn_limb *r,
+                               int n,
+                               int k,
+                               fbn_limb *v1,
+                               fbn_limb *vm1,
+                               fbn_limb *v2)
+{
+    int m = 2 * k + 2, s = n - 2 * k;
+    const fbn_limb *v0 = r, *vinf = r + 4 * k;
+
+    __fbn_sub_n(v2, v2, vm1, m); /* v2 = (v2 - vm1) / 3 */
+    __fbn_divexact3_n(v2, v2, m); /*    = c1 + c2 + 3c3 + 5c4 */
+    __fbn_sub_n(vm1, v1, vm1, m); /* vm1 = (v1 - vm1) / 2 */
+    __fbn_rshift1_n(vm1, vm1, m); /*     = c1 + c3 */
+    __fbn_sub(v1, v1, m, v0, 2 * k); /* v1 = v1 - v0 = c1 + c2 + c3 + c4 */
+    __fbn_sub_n(v2, v2, v1, m); /* v2 = (v2 - v1) / 2 */
+    __fbn_rshift1_n(v2, v2, m); /*    = c3 + 2c4 */
+    __fbn_sub_n(v1, v1, vm1, m); /* v1 = v1 - vm1 - vinf */
+    __fbn_sub(v1, v1, m, vinf, 2 * s); /*    = c2 */
+    __fbn_sub(v2, v2, m, vinf, 2 * s); /* v2 = v2 - 2vinf */
+    __fbn_sub(v2, v2, m, vinf, 2 * s); /*    = c3 */
+    __fbn_sub_n(vm1, vm1, v2, m); /* vm1 = vm1 - v2 = c1 */
+
+    /* r += c1 * B^k + c2 * B^2k + c3 * B^3k, the limbs beyond r are zero */
+    __fbn_add(r + k, r + k, 2 * n - k, vm1, m);
+    __fbn_add(r + 2 * k, r + 2 * k, 2 * n - 2 * k, v1, m);
+    __fbn_add(r + 3 * k, r + 3 * k, 2 * n - 3 * k, v2,
+              m < 2 * n - 3 * k ? m : 2 * n - 3 * k);
+}
+
+/*
+ * Evaluate the Toom-3 split of a at x = 0 + 2 (the even part), x = 1, x = -1
+ * and x = 2, where a = a2 * B^2k + a1 * B^k + a0 and a2 has s limbs.
+ * @e: (k + 1) limbs to store a0 + a2
+ * @p1, @pm1, @p2: (k + 1) limbs to store a(1), |a(-1)|, a(2)
+ * Return 1 if a(-1) < 0, otherwise 0.
+ */
+static int __fbn_toom3_eval(fbn_limb *e,
+                            fbn_limb *p1,
+                            fbn_limb *pm1,
+                            fbn_limb *p2,
+                            const fbn_limb *a,
+                            int k,
+                            int s)
+{
+    const fbn_limb *a1 = a + k, *a2 = a + 2 * k;
+
+    /* e = a0 + a2 */
+    e[k] = __fbn_add(e, a, k, a2, s);
+    /* p1 = e + a1 */
+    p1[k] = e[k] + __fbn_add_n(p1, e, a1, k);
+    /* pm1 = |e - a1| */
+    memcpy(pm1, a1, sizeof(fbn_limb) * k);
+    pm1[k] = 0;
+    int neg = __fbn_absdiff_n(pm1, e, pm1, k + 1);
+    /* p2 = a0 + 2a1 + 4a2 */
+    memcpy(p2, a, sizeof(fbn_limb) * k);
+    p2[k] = __fbn_addmul_1(p2, a1, k, 2);
+    __fbn_add_1(p2 + s, k + 1 - s, __fbn_addmul_1(p2, a2, s, 4));
+    return neg;
+}
+
+/*
+ * r = a * b by Toom-3, a and b both have n limbs, r has 2n limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ *
+ *   a = a2 * B^2k + a1 * B^k + a0, where k = ceil(n / 3), so does b.
+ *   a(x)b(x) is evaluated at x = 0, 1, -1, 2, inf and then interpolated.
+ */
+static void __fbn_mul_toom3(fbn_limb *r,
+                            const fbn_limb *a,
+                            const fbn_limb *b,
+                            int n,
+                            fbn_limb *scratch)
+{
+    int k = (n + 2) / 3, s = n - 2 * k, m = 2 * k + 2;
+    fbn_limb *v1 = scratch, *vm1 = v1 + m, *v2 = vm1 + m;
+    fbn_limb *ea = v2 + m, *eb = ea + 4 * (k + 1);
+    fbn_limb *next = eb + 4 * (k + 1);
+    fbn_limb *pa[3] = {ea + (k + 1), ea + 2 * (k + 1), ea + 3 * (k + 1)};
+    fbn_limb *pb[3] = {eb + (k + 1), eb + 2 * (k + 1), eb + 3 * (k + 1)};
+
+    int neg = __fbn_toom3_eval(ea, pa[0], pa[1], pa[2], a, k, s) ^
+              __fbn_toom3_eval(eb, pb[0], pb[1], pb[2], b, k, s);
+    __fbn_mul_n(v1, pa[0], pb[0], k + 1, next);
+    __fbn_mul_n(vm1, pa[1], pb[1], k + 1, next);
+    if (neg)
+        __fbn_neg_n(vm1, m);
+    __fbn_mul_n(v2, pa[2], pb[2], k + 1, next);
+
+    __fbn_mul_n(r, a, b, k, next); /* v0 */
+    memset(r + 2 * k, 0, sizeof(fbn_limb) * 2 * k);
+    __fbn_mul_n(r + 4 * k, a + 2 * k, b + 2 * k, s, next); /* vinf */
+
+    __fbn_toom3_interp(r, n, k, v1, vm1, v2);
+}
+
+/*
+ * r = a * b, where a and b both have n limbs, r has 2n limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ *
+ * Dispatch by size: long multiplication, Karatsuba or Toom-3.
+ */
+static void __fbn_mul_n(fbn_limb *r,
+                        const fbn_limb *a,
+                        const fbn_limb *b,
+                        int n,
+                        fbn_limb *scratch)
+{
+    if (!fbn_kara_worth(n))
+        __fbn_mul_basecase(r, a, n, b, n);
+    else if (!fbn_toom3_worth(n))
+        __fbn_mul_kara(r, a, b, n, scratch);
+    else
+        __fbn_mul_toom3(r, a, b, n, scratch);
+}
+
+/*
+ * r = a * b, where an >= bn, r has (an + bn) limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(bn)
+ *
+ * The longer operand is cut into bn-limb pieces, so that every piece can be
+ * multiplied in balance.
+ */
+static void __fbn_mul(fbn_limb *r,
+                      const fbn_limb *a,
+                      int an,
+                      const fbn_limb *b,
+                      int bn,
+                      fbn_limb *scratch)
+{
+    if (!fbn_kara_worth(bn)) {
+        __fbn_mul_basecase(r, a, an, b, bn);
+        return;
+    }
+
+    __fbn_mul_n(r, a, b, bn, scratch);
+    if (an == bn)
+        return;
+
+    /* r[bn + offset ...] += a[offset ...] * b, piece by piece */
+    fbn_limb *prod = scratch, *next = scratch + 2 * bn;
+    for (int offset = bn; offset < an; offset += bn) {
+        int pn = an - offset < bn ? an - offset : bn;
+        if (pn == bn)
+            __fbn_mul_n(prod, a + offset, b, bn, next);
+        else
+            __fbn_mul(prod, b, bn, a + offset, pn, next);
+        /* the limbs above r[offset + bn] have not been written yet */
+        fbn_limb carry = __fbn_add_n(r + offset, r + offset, prod, bn);
+        memcpy(r + offset + bn, prod + bn, sizeof(fbn_limb) * pn);
+        __fbn_add_1(r + offset + bn, pn, carry);
+    }
+}
+
+/*
+ * r = a^2, where a has n limbs, r has 2n limbs.
+ * @r cannot overlap @a.
+ *
+ * Every cross product a[i] * a[j] (i < j) is computed once, then the sum is
+ * doubled and the diagonal terms a[i]^2 are added.
+ */
+static void __fbn_sqr_basecase(fbn_limb *r, const fbn_limb *a, int n)
+{
+    /* cross products */
+    r[0] = 0;
+    r[2 * n - 1] = 0;
+    if (n > 1) {
+        r[n] = __fbn_mul_1(r + 1, a + 1, n - 1, a[0]);
+        for (int i = 1; i < n - 1; ++i)
+            r[n + i] = __fbn_addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+
+    /* double the cross products and add the diagonal terms */
+    fbn_limb hibit = 0;
+    fbn_dlimb bcabinet = 0;
+    for (int i = 0; i < n; ++i) {
+        fbn_dlimb sq = (fbn_dlimb) a[i] * a[i];
+        fbn_limb lo = r[2 * i], hi = r[2 * i + 1];
+
+        bcabinet += (fbn_dlimb) (fbn_limb) (lo << 1 | hibit) + (fbn_limb) sq;
+        r[2 * i] = bcabinet;
+        bcabinet >>= FBN_LIMB_BITS;
+        bcabinet += (fbn_dlimb) (fbn_limb) (hi << 1 | lo >> (FBN_LIMB_BITS - 1)) +
+                    (fbn_limb) (sq >> FBN_LIMB_BITS);
+        r[2 * i + 1] = bcabinet;
+        bcabinet >>= FBN_LIMB_BITS;
+        hibit = hi >> (FBN_LIMB_BITS - 1);
+    }
+}
+
+/*
+ * r = a^2 by Karatsuba, where a has n limbs, r has 2n limbs.
+ * @r cannot overlap @a or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ *
+ *   a = a1 * B^l + a0, where l = ceil(n / 2)
+ *   a^2 = a1^2 * B^2l + (a0^2 + a1^2 - (a0 - a1)^2) * B^l + a0^2
+ */
+static void __fbn_sqr_kara(fbn_limb *r,
+                           const fbn_limb *a,
+                           int n,
+                           fbn_limb *scratch)
+{
+    int l = n - (n >> 1), h = n >> 1;
+    fbn_limb *d = scratch, *da = scratch + 2 * l, *next = scratch + 3 * l;
+
+    /* da = |a0 - a1|, the high half may be 1 limb shorter */
+    memcpy(da, a + l, sizeof(fbn_limb) * h);
+    if (l > h)
+        da[h] = 0;
+    __fbn_absdiff_n(da, a, da, l);
+
+    __fbn_sqr_n(d, da, l, next);            /* d = da^2 */
+    __fbn_sqr_n(r, a, l, next);             /* r_low = a0^2 */
+    __fbn_sqr_n(r + 2 * l, a + l, h, next); /* r_high = a1^2 */
+
+    /* middle term: d = a0^2 + a1^2 - d, carry from the (2l)-th limb */
+    long carry = -(long) __fbn_sub_n(d, r, d, 2 * l);
+    fbn_limb carry_h = __fbn_add_n(d, d, r + 2 * l, 2 * h);
+    carry += __fbn_add_1(d + 2 * h, 2 * (l - h), carry_h);
+
+    /* r += d * B^l, the middle term is non-negative so is the carry */
+    carry += __fbn_add_n(r + l, r + l, d, 2 * l);
+    __fbn_add_1(r + 3 * l, 2 * n - 3 * l, carry);
+}
+
+/*
+ * r = a^2 by Toom-3, where a has n limbs, r has 2n limbs.
+ * @r cannot overlap @a or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ */
+static void __fbn_sqr_toom3(fbn_limb *r,
+                            const fbn_limb *a,
+                            int n,
+                            fbn_limb *scratch)
+{
+    int k = (n + 2) / 3, s = n - 2 * k, m = 2 * k + 2;
+    fbn_limb *v1 = scratch, *vm1 = v1 + m, *v2 = vm1 + m;
+    fbn_limb *ea = v2 + m, *next = ea + 4 * (k + 1);
+    fbn_limb *pa[3] = {ea + (k + 1), ea + 2 * (k + 1), ea + 3 * (k + 1)};
+
+    /* a(-1)^2 is never negative */
+    __fbn_toom3_eval(ea, pa[0], pa[1], pa[2], a, k, s);
+    __fbn_sqr_n(v1, pa[0], k + 1, next);
+    __fbn_sqr_n(vm1, pa[1], k + 1, next);
+    __fbn_sqr_n(v2, pa[2], k + 1, next);
+
+    __fbn_sqr_n(r, a, k, next); /* v0 */
+    memset(r + 2 * k, 0, sizeof(fbn_limb) * 2 * k);
+    __fbn_sqr_n(r + 4 * k, a + 2 * k, s, next); /* vinf */
+
+    __fbn_toom3_interp(r, n, k, v1, vm1, v2);
+}
+
+/*
+ * r = a^2, where a has n limbs, r has 2n limbs.
+ * @r cannot overlap @a or @scratch.
+ * @scratch: temporary limbs, at least FBN_MUL_SCRATCH(n)
+ *
+ * Dispatch by size: basecase, Karatsuba or Toom-3 squaring.
+ */
+static void __fbn_sqr_n(fbn_limb *r,
+                        const fbn_limb *a,
+                        int n,
+                        fbn_limb *scratch)
+{
+    if (!fbn_kara_sqr_worth(n))
+        __fbn_sqr_basecase(r, a, n);
+    else if (!fbn_toom3_sqr_worth(n))
+        __fbn_sqr_kara(r, a, n, scratch);
+    else
+        __fbn_sqr_toom3(r, a, n, scratch);
+}
+
+/*
+ * Upper bound of the scratch limbs used by __fbn_mul() with bn = @n, or by
+ * __fbn_sqr_n() with n = @n. Every recursion level takes less than
+ * (10/3 n + 14) limbs on a third of the operands (Toom-3) or 4 * ceil(n/2)
+ * limbs on a half (Karatsuba), plus the unbalanced pieces in __fbn_mul().
+ */
+#define FBN_MUL_SCRATCH(n) (14 * (n) + 1024)
+
+/*
+ * Preallocated scratch area for the multiplication temporaries. It only grows
+ * and is kept until fbn_scratch_free(), so the fast doubling loop stops
+ * allocating once the numbers stop growing. One product uses it at a time
+ * (fbn_scratch_lock), concurrent ones allocate their own or wait for it if
+ * they cannot.
+ */
+static DEFINE_MUTEX(fbn_scratch_lock);
+static fbn_limb *fbn_scratch;
+static size_t fbn_scratch_cap;
+
+/*
+ * Make sure the scratch area has at least @len limbs.
+ * Return the scratch area, or NULL on failure.
+ */
+static fbn_limb *fbn_scratch_reserve(size_t len)
+{
+    if (likely(len <= fbn_scratch_cap))
+        return fbn_scratch;
+    size_t new_cap = ROUNDUP4(len + (len >> 1));
+    fbn_limb *new = kvmalloc_array(new_cap, sizeof(fbn_limb), GFP_KERNEL);
+    if (unlikely(!new))
+        return NULL;
+    kvfree(fbn_scratch);
+    fbn_scratch = new;
+    fbn_scratch_cap = new_cap;
+    return new;
+}
+
+/* Release the scratch area of the multiplication */
+void fbn_scratch_free(void)
+{
+    mutex_lock(&fbn_scratch_lock);
+    kvfree(fbn_scratch);
+    fbn_scratch = NULL;
+    fbn_scratch_cap = 0;
+    mutex_unlock(&fbn_scratch_lock);
+}
+
+/*
+ * Workqueue of the parallel paths. fbn_wq_busy counts the parts queued and
+ * not flushed yet, a part beyond its max_active is run by the caller, so a
+ * part waiting for parts of its own (a doubling step, the NTT phases of its
+ * products, the halves of a printed piece) never waits for one which has no
+ * worker.
+ */
+static struct workqueue_struct *fbn_wq;
+static atomic_t fbn_wq_busy = ATOMIC_INIT(0);
+
+/*
+ * Create the workqueue of the parallel paths.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_wq_init(void)
+{
+    fbn_wq = alloc_workqueue("fbn", WQ_UNBOUND, FBN_WQ_MAX_ACTIVE);
+    return likely(fbn_wq) ? 0 : -ENOMEM;
+}
+
+/* Wait for the workqueue of the parallel paths and destroy it */
+void fbn_wq_destroy(void)
+{
+    if (fbn_wq)
+        destroy_workqueue(fbn_wq);
+    fbn_wq = NULL;
+}
+
+/*
+ * Queue a part of a parallel path if a worker takes it at once.
+ * Return false if it is not queued.
+ */
+bool fbn_queue_work(struct work_struct *work)
+{
+    if (!fbn_wq)
+        return false;
+    if (atomic_inc_return(&fbn_wq_busy) > FBN_WQ_MAX_ACTIVE) {
+        atomic_dec(&fbn_wq_busy);
+        return false;
+    }
+    queue_work(fbn_wq, work);
+    return true;
+}
+
+/* Wait for a part queued by fbn_queue_work() */
+void fbn_flush_work(struct work_struct *work)
+{
+    flush_work(work);
+    atomic_dec(&fbn_wq_busy);
+}
+
+/*
+ * Where the scratch area of one product comes from, to give it back by
+ * fbn_product_release().
+ * [arena] the arena the scratch area is carved from, or NULL
+ * [mark] [arena]'s mark after c is grown
+ * [own] a private scratch area to free, or NULL
+ * [shared] fbn_scratch is used (fbn_scratch_lock is held)
+ */
+struct fbn_product {
+    struct fbn_arena *arena;
+    size_t mark;
+    fbn_limb *own;
+    int shared;
+};
+
+/*
+ * Take the shared scratch area with at least @len limbs if it is free,
+ * otherwise allocate a private one. Short of memory for that, wait for the
+ * shared one: it may be large enough already.
+ * Return the scratch area, or NULL on failure.
+ */
+static fbn_limb *fbn_scratch_get(size_t len, struct fbn_product *pd)
+{
+    if (!mutex_trylock(&fbn_scratch_lock)) {
+        pd->own = kvmalloc_array(len, sizeof(fbn_limb), GFP_KERNEL);
+        if (likely(pd->own))
+            return pd->own;
+        mutex_lock(&fbn_scratch_lock);
+    }
+    fbn_limb *scratch = fbn_scratch_reserve(len);
+    if (unlikely(!scratch)) {
+        mutex_unlock(&fbn_scratch_lock);
+        return NULL;
+    }
+    pd->shared = 1;
+    return scratch;
+}
+
+/*
+ * Get the limbs to store a @len-limb product of c, which are in the scratch
+ * area if c is also an operand (@inplace), otherwise c's own num. The scratch
+ * area is carved from @arena if it is not NULL, otherwise it is the shared
+ * one or a private one. Release it with fbn_product_release() in any case.
+ * c's num is grown first, so the operand pointers must be read afterwards.
+ * @work_len: scratch limbs needed by the multiplication algorithm
+ * @work: return the scratch limbs for the multiplication algorithm
+ * @pd: return where the scratch area comes from
+ * Return NULL on failure.
+ */
+static fbn_limb *fbn_product_begin(fbn *c,
+                                   int inplace,
+                                   int len,
+                                   size_t work_len,
+                                   struct fbn_arena *arena,
+                                   fbn_limb **work,
+                                   struct fbn_product *pd)
+{
+    /* keep the work area 16-byte aligned */
+    size_t prod_len = inplace ? ROUNDUP4(len) : 0;
+    fbn_limb *scratch = NULL;
+
+    *work = NULL;
+    *pd = (struct fbn_product){.arena = arena,
+                               .mark = fbn_arena_mark(arena)};
+    if (unlikely(fbn_reserve(c, len) < 0))
+        return NULL;
+    /* c's grown num stays in the arena */
+    pd->mark = fbn_arena_mark(arena);
+    if (prod_len + work_len) {
+        if (arena)
+            scratch = fbn_arena_alloc(arena,
+                                      sizeof(fbn_limb) * (prod_len + work_len));
+        else
+            scratch = fbn_scratch_get(prod_len + work_len, pd);
+        if (unlikely(!scratch))
+            return NULL;
+        *work = scratch + prod_len;
+    }
+    return inplace ? scratch : c->num;
+}
+
+/* Give back the scratch area of fbn_product_begin() */
+static void fbn_product_release(struct fbn_product *pd)
+{
+    fbn_arena_pop(pd->arena, pd->mark);
+    kvfree(pd->own);
+    if (pd->shared)
+        mutex_unlock(&fbn_scratch_lock);
+}
+
+/* Pass the @len-limb product to c and truncate the leading zero element */
+static void fbn_product_end(fbn *c, const fbn_limb *prod, int len)
+{
+    c->len = len; /* fbn_product_begin() has reserved it */
+    if (prod != c->num)
+        memcpy(c->num, prod, sizeof(fbn_limb) * len);
+    if (!fbn_lastelmt(c))
+        c->len = len - 1;
+}
+
+/* Scratch limbs of fbn_mul() on an @an x @bn product, an >= bn */
+static size_t fbn_mul_work(int an, int bn)
+{
+    if (fbn_ntt_worth(bn))
+        return fbn_ntt_scratch(an, bn);
+    if (fbn_kara_worth(bn))
+        return FBN_MUL_SCRATCH(bn);
+    return 0;
+}
+
+/* Scratch limbs of fbn_sqr() on an @n-limb operand */
+static size_t fbn_sqr_work(int n)
+{
+    if (fbn_ntt_worth(n))
+        return fbn_ntt_scratch(n, 0);
+    if (fbn_kara_sqr_worth(n))
+        return FBN_MUL_SCRATCH(n);
+    return 0;
+}
+
+/*
+ * c = a * b with the scratch area carved from @arena, or the shared or a
+ * private one if @arena is NULL.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fbn_mul_scratch(fbn *c, fbn *a, fbn *b, struct fbn_arena *arena)
+{
+    /* trivial case */
+    if (unlikely(fbn_iszero(a) || fbn_iszero(b))) {
+        fbn_set_u32(c, 0); /* c = 0 */
+        return 0;
+    }
+
+    /* a->num is always the longest one */
+    if (a->len < b->len)
+        fbn_swap(a, b);
+    int new_len = a->len + b->len;
+    struct fbn_product pd;
+    fbn_limb *work, *prod = fbn_product_begin(c, c == a || c == b, new_len,
+                                              fbn_mul_work(a->len, b->len),
+                                              arena, &work, &pd);
+    int rc = -ENOMEM;
+    if (unlikely(!prod))
+        goto out;
+    if (fbn_ntt_worth(b->len))
+        fbn_ntt_mul(prod, a->num, a->len, b->num, b->len, work);
+    else
+        __fbn_mul(prod, a->num, a->len, b->num, b->len, work);
+    fbn_product_end(c, prod, new_len);
+    rc = 0;
+out:
+    fbn_product_release(&pd);
+    return rc;
+}
+
+/*
+ * c = a * b. a *= b is also acceptable.
+ * Long multiplication, Karatsuba, Toom-3 or NTT is chosen by the operand
+ * length.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_mul(fbn *c, fbn *a, fbn *b)
+{
+    return fbn_mul_scratch(c, a, b, c->arena);
+}
+
+/* c = a^2 with the scratch area like fbn_mul_scratch() */
+static int fbn_sqr_scratch(fbn *c, fbn *a, struct fbn_arena *arena)
+{
+    /* trivial case */
+    if (unlikely(fbn_iszero(a))) {
+        fbn_set_u32(c, 0); /* c = 0 */
+        return 0;
+    }
+
+    int new_len = 2 * a->len;
+    struct fbn_product pd;
+    fbn_limb *work, *prod = fbn_product_begin(
+        c, c == a, new_len, fbn_sqr_work(a->len), arena, &work, &pd);
+    int rc = -ENOMEM;
+    if (unlikely(!prod))
+        goto out;
+    if (fbn_ntt_worth(a->len))
+        fbn_ntt_sqr(prod, a->num, a->len, work);
+    else
+        __fbn_sqr_n(prod, a->num, a->len, work);
+    fbn_product_end(c, prod, new_len);
+    rc = 0;
+out:
+    fbn_product_release(&pd);
+    return rc;
+}
+
+/*
+ * c = a^2 (basecase, Karatsuba, Toom-3 or NTT). a = a^2 is also acceptable.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_sqr(fbn *c, fbn *a)
+{
+    return fbn_sqr_scratch(c, a, c->arena);
+}
+
+/* Scratch limbs of any product of operands up to @n limbs */
+static size_t fbn_mul_work_bound(int n)
+{
+    /* Karatsuba and Toom-3 below the NTT threshold may need more than NTT */
+    size_t work = FBN_MUL_SCRATCH(n);
+    if (fbn_ntt_worth(n) && work < fbn_ntt_scratch(n, n))
+        work = fbn_ntt_scratch(n, n);
+    return work;
+}
+
+/*
+ * r = a * b of any lengths, r has (an + bn) limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least fbn_mul_work_bound(max(an, bn))
+ */
+static void __fbn_mul_any(fbn_limb *r,
+                          const fbn_limb *a,
+                          int an,
+                          const fbn_limb *b,
+                          int bn,
+                          fbn_limb *scratch)
+{
+    if (an < bn) {
+        const fbn_limb *t = a;
+        a = b;
+        b = t;
+        int tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (unlikely(!bn)) {
+        memset(r, 0, sizeof(fbn_limb) * an);
+        return;
+    }
+    if (fbn_ntt_worth(bn))
+        fbn_ntt_mul(r, a, an, b, bn, scratch);
+    else
+        __fbn_mul(r, a, an, b, bn, scratch);
+}
+
+/* Length of @n limbs without the leading zero limbs */
+static int __fbn_normlen(const fbn_limb *a, int n)
+{
+    while (n > 0 && !a[n - 1])
+        --n;
+    return n;
+}
+
+/* Compare a and b, return -1, 0 or 1 as a < b, a == b or a > b */
+static int __fbn_cmp(const fbn_limb *a, int an, const fbn_limb *b, int bn)
+{
+    an = __fbn_normlen(a, an);
+    bn = __fbn_normlen(b, bn);
+    if (an != bn)
+        return an < bn ? -1 : 1;
+    for (int i = an - 1; i >= 0; --i) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Limb length of the reciprocal below: floor(B^(2n) / d) < B^(n + 1) */
+#define FBN_INV_LEN(n) ((n) + 2)
+/* Reciprocals up to this length are computed bit by bit */
+#define FBN_INV_BASECASE 8
+/* Scratch limbs of __fbn_invert() */
+#define FBN_INV_SCRATCH(n) \
+    (7 * (size_t) (n) + 8 + fbn_mul_work_bound(2 * (n) + 2))
+
+/*
+ * inv = floor(B^(2n) / d), where B = 2^FBN_LIMB_BITS and the leading limb of
+ * d is nonzero. inv has FBN_INV_LEN(n) limbs.
+ * @scratch: temporary limbs, at least FBN_INV_SCRATCH(n)
+ *
+ * The leading half of d is inverted recursively, then one Newton step
+ * x += x * (B^(2n) - d * x) / B^(2n) doubles the precision, and the last few
+ * units are fixed by comparing d * x with B^(2n).
+ */
+static void __fbn_invert(fbn_limb *inv,
+                         const fbn_limb *d,
+                         int n,
+                         fbn_limb *scratch)
+{
+    const int len = FBN_INV_LEN(n), tn = 2 * n + 2;
+
+    if (n <= FBN_INV_BASECASE) {
+        /* shift B^(2n) into the remainder bit by bit */
+        fbn_limb *rem = scratch; /* rem < 2d, n + 1 limbs */
+        memset(inv, 0, sizeof(fbn_limb) * len);
+        memset(rem, 0, sizeof(fbn_limb) * (n + 1));
+        rem[0] = 1;
+        for (int i = 2 * n * FBN_LIMB_BITS - 1; i >= 0; --i) {
+            __fbn_add_n(rem, rem, rem, n + 1); /* rem <<= 1 */
+            if (__fbn_cmp(rem, n + 1, d, n) >= 0) {
+                __fbn_sub(rem, rem, n + 1, d, n);
+                inv[DIVLIMB(i)] |= (fbn_limb) 1 << MODLIMB(i);
+            }
+        }
+        return;
+    }
+
+    /* x = floor(B^(2h) / dh) * B^(n - h), dh is the leading h limbs of d */
+    int h = n / 2 + 3;
+    memset(inv, 0, sizeof(fbn_limb) * (n - h));
+    __fbn_invert(inv + n - h, d + n - h, h, scratch);
+
+    fbn_limb *t = scratch;    /* d * x, 2n + 2 limbs */
+    fbn_limb *e = t + tn;     /* B^(2n) - d * x, 2n + 2 limbs */
+    fbn_limb *p = e + tn;     /* x * e, 3n + 4 limbs */
+    fbn_limb *work = p + len + tn;
+    __fbn_mul_any(t, d, n, inv, len, work);
+    memset(e, 0, sizeof(fbn_limb) * tn);
+    e[2 * n] = 1;
+    int neg = __fbn_cmp(e, tn, t, tn) < 0;
+    if (neg)
+        __fbn_sub_n(e, t, e, tn);
+    else
+        __fbn_sub_n(e, e, t, tn);
+
+    /* Newton step, the correction is x * |e| / B^(2n) */
+    int en = __fbn_normlen(e, tn);
+    if (en + len > 2 * n) {
+        __fbn_mul_any(p, inv, len, e, en, work);
+        int cn = __fbn_normlen(p + 2 * n, en + len - 2 * n);
+        if (cn > len)
+            cn = len; /* not reached with a sane estimate */
+        if (neg)
+            __fbn_sub(inv, inv, len, p + 2 * n, cn);
+        else
+            __fbn_add(inv, inv, len, p + 2 * n, cn);
+    }
+
+    /* fix the last units: 0 <= B^(2n) - d * x < d */
+    __fbn_mul_any(t, d, n, inv, len, work);
+    memset(e, 0, sizeof(fbn_limb) * tn);
+    e[2 * n] = 1;
+    while (__fbn_cmp(t, tn, e, tn) > 0) {
+        __fbn_sub_1(inv, len, 1);
+        __fbn_sub(t, t, tn, d, n);
+    }
+    __fbn_sub_n(e, e, t, tn);
+    while (__fbn_cmp(e, tn, d, n) >= 0) {
+        __fbn_add_1(inv, len, 1);
+        __fbn_sub(e, e, tn, d, n);
+    }
+}
+
+/*
+ * Power table of the decimal conversion, kept until fbn_dec_pow_free() to be
+ * reused by later requests.
+ * [num] FBN_DECBASE^(2^k) of [len] limbs
+ * [inv] its reciprocal by __fbn_invert(), NULL until it is used as a divisor
+ */
+struct fbn_dec_pow {
+    fbn_limb *num;
+    fbn_limb *inv;
+    int len;
+};
+/* FBN_DECBASE^(2^31) is far beyond any int length of fbn */
+#define FBN_DEC_LEVELS 32
+/* Pieces below FBN_DECBASE^(2^FBN_DEC_DC_LEVEL) are short-divided */
+#define FBN_DEC_DC_LEVEL 3
+static struct fbn_dec_pow fbn_dec_pows[FBN_DEC_LEVELS];
+/*
+ * Serializes the growth of fbn_dec_pows. A level, once built, is never
+ * changed until fbn_dec_pow_free(), so it is read without the lock.
+ */
+static DEFINE_MUTEX(fbn_dec_pow_lock);
+
+int fbn_dec_dc_threshold = FBN_DEC_DC_THRESHOLD;
+
+/* Release the power table of the decimal conversion */
+void fbn_dec_pow_free(void)
+{
+    mutex_lock(&fbn_dec_pow_lock);
+    for (int k = 0; k < FBN_DEC_LEVELS; ++k) {
+        kvfree(fbn_dec_pows[k].num);
+        kvfree(fbn_dec_pows[k].inv);
+        fbn_dec_pows[k].num = fbn_dec_pows[k].inv = NULL;
+        fbn_dec_pows[k].len = 0;
+    }
+    mutex_unlock(&fbn_dec_pow_lock);
+}
+
+/* fbn_dec_pow_prepare() with fbn_dec_pow_lock held */
+static int __fbn_dec_pow_prepare(int len)
+{
+    struct fbn_dec_pow *pw = fbn_dec_pows;
+    fbn_limb *scratch = NULL;
+    size_t scratch_len = 0;
+    int k;
+
+    if (unlikely(!pw[0].num)) {
+        pw[0].num = kvmalloc_array(1, sizeof(fbn_limb), GFP_KERNEL);
+        if (unlikely(!pw[0].num))
+            return -1;
+        pw[0].num[0] = FBN_DECBASE;
+        pw[0].len = 1;
+    }
+    /* fbn_dec_dc_top() compares with the powers up to FBN_DEC_DC_LEVEL + 1 */
+    for (k = 0; pw[k].len <= len || k <= FBN_DEC_DC_LEVEL; ++k) {
+        if (unlikely(k + 1 >= FBN_DEC_LEVELS))
+            goto fail;
+        int n = pw[k].len;
+        /* both FBN_INV_SCRATCH(n) and the squaring are covered */
+        if (scratch_len < FBN_INV_SCRATCH(n)) {
+            kvfree(scratch);
+            scratch_len = FBN_INV_SCRATCH(n);
+            scratch = kvmalloc_array(scratch_len, sizeof(fbn_limb), GFP_KERNEL);
+            if (unlikely(!scratch))
+                goto fail;
+        }
+        if (k >= FBN_DEC_DC_LEVEL && pw[k].len <= len && !pw[k].inv) {
+            fbn_limb *inv =
+                kvmalloc_array(FBN_INV_LEN(n), sizeof(fbn_limb), GFP_KERNEL);
+            if (unlikely(!inv))
+                goto fail;
+            __fbn_invert(inv, pw[k].num, n, scratch);
+            pw[k].inv = inv;
+        }
+        if (!pw[k + 1].num) {
+            fbn_limb *sq = kvmalloc_array(2 * n, sizeof(fbn_limb), GFP_KERNEL);
+            if (unlikely(!sq))
+                goto fail;
+            if (fbn_ntt_worth(n))
+                fbn_ntt_sqr(sq, pw[k].num, n, scratch);
+            else
+                __fbn_sqr_n(sq, pw[k].num, n, scratch);
+            pw[k + 1].len = __fbn_normlen(sq, 2 * n);
+            pw[k + 1].num = sq;
+        }
+    }
+    kvfree(scratch);
+    return k;
+fail:
+    kvfree(scratch);
+    return -1;
+}
+
+/*
+ * Build the power table until a power is longer than @len limbs, with the
+ * reciprocals of the powers used as divisors on a @len-limb number.
+ * Return the level of the longer power, or -1 on failure.
+ */
+static int fbn_dec_pow_prepare(int len)
+{
+    mutex_lock(&fbn_dec_pow_lock);
+    int k = __fbn_dec_pow_prepare(len);
+    mutex_unlock(&fbn_dec_pow_lock);
+    return k;
+}
+
+/* Scratch limbs of fbn_dec_divrem() by an @n-limb power */
+#define FBN_DEC_DIVREM_SCRATCH(n) \
+    (2 * (size_t) (n) + 3 + fbn_mul_work_bound((n) + 2))
+
+/*
+ * q = x / d and r = x % d by Barrett reduction, where d is a power of the
+ * table with its reciprocal and x < d^2.
+ * @q: (n + 2) limbs, @qn: return q's length
+ * @r: xn limbs, @rn: return r's length
+ * @scratch: temporary limbs, at least FBN_DEC_DIVREM_SCRATCH(n)
+ */
+static void fbn_dec_divrem(fbn_limb *q,
+                           int *qn,
+                           fbn_limb *r,
+                           int *rn,
+                           const fbn_limb *x,
+                           int xn,
+                           const struct fbn_dec_pow *pw,
+                           fbn_limb *scratch)
+{
+    const int n = pw->len;
+
+    if (__fbn_cmp(x, xn, pw->num, n) < 0) {
+        memcpy(r, x, sizeof(fbn_limb) * xn);
+        *rn = xn;
+        *qn = 0;
+        return;
+    }
+
+    /* q = ((x / B^(n - 1)) * inv) / B^(n + 1) is at most 2 less */
+    int q1n = xn - n + 1;
+    fbn_limb *prod = scratch;           /* q1n + n + 2 limbs */
+    fbn_limb *work = prod + 2 * n + 3;
+    __fbn_mul_any(prod, x + n - 1, q1n, pw->inv, FBN_INV_LEN(n), work);
+    int len = __fbn_normlen(prod + n + 1, q1n + 1);
+    memcpy(q, prod + n + 1, sizeof(fbn_limb) * len);
+
+    /* r = x - q * d */
+    __fbn_mul_any(prod, q, len, pw->num, n, work);
+    __fbn_sub(r, x, xn, prod, __fbn_normlen(prod, len + n));
+    *rn = __fbn_normlen(r, xn);
+    while (__fbn_cmp(r, *rn, pw->num, n) >= 0) {
+        __fbn_sub(r, r, *rn, pw->num, n);
+        *rn = __fbn_normlen(r, *rn);
+        q[len] = 0;
+        __fbn_add_1(q, len + 1, 1);
+        len = __fbn_normlen(q, len + 1);
+    }
+    *qn = len;
+}
+
+/* Scratch limbs of the decimal conversion on a @len-limb number */
+static size_t fbn_dec_scratch(int len)
+{
+    /* q and r of every level, the powers are halved on the way down */
+    size_t total = FBN_DEC_DIVREM_SCRATCH(len);
+    for (int n = len;; n = n / 2 + 1) {
+        total += 3 * (size_t) n + 2;
+        if (n <= 2)
+            break;
+    }
+    return total;
+}
+
+/*
+ * Print x (n limbs, destroyed) by short division ending at @end, in exactly
+ * @chunks pieces of FBN_DECBASE_DIGITS digits, or until x is 0 if @chunks is
+ * negative.
+ * Return the head of the string.
+ */
+static char *fbn_dec_basecase(char *end, fbn_limb *x, int n, int chunks)
+{
+    n = __fbn_normlen(x, n);
+    for (; n && chunks; --chunks) {
+        end = put_dec_limb(end, fbn_divdecbase(x, n));
+        n -= !x[n - 1];
+    }
+    if (chunks > 0) {
+        end -= chunks * FBN_DECBASE_DIGITS;
+        memset(end, '0', chunks * FBN_DECBASE_DIGITS);
+    }
+    return end;
+}
+
+int fbn_dec_par_threshold = FBN_DEC_PAR_THRESHOLD;
+
+static void fbn_dec_dc(char *end,
+                       fbn_limb *x,
+                       int xn,
+                       int k,
+                       fbn_limb *scratch,
+                       int cpus);
+
+/*
+ * The high half of a piece printed by a worker into its own place.
+ * [work] the work item on the caller's stack
+ * [end], [x], [xn], [k], [cpus] the arguments of fbn_dec_dc()
+ * [scratch] from kvmalloc, for this half only
+ */
+struct fbn_dec_task {
+    struct work_struct work;
+    char *end;
+    fbn_limb *x;
+    int xn;
+    int k;
+    int cpus;
+    fbn_limb *scratch;
+};
+
+static void fbn_dec_run(struct work_struct *work)
+{
+    struct fbn_dec_task *t = container_of(work, struct fbn_dec_task, work);
+
+    fbn_dec_dc(t->end, t->x, t->xn, t->k, t->scratch, t->cpus);
+}
+
+/*
+ * Print x < FBN_DECBASE^(2^(k + 1)) (destroyed) ending at @end, in exactly
+ * 2^(k + 1) pieces of FBN_DECBASE_DIGITS digits. Both halves end at a fixed
+ * place of the string, so a long piece gives its high half and half of
+ * @cpus to a worker.
+ * @cpus: CPUs this piece may use
+ */
+static void fbn_dec_dc(char *end,
+                       fbn_limb *x,
+                       int xn,
+                       int k,
+                       fbn_limb *scratch,
+                       int cpus)
+{
+    if (k < FBN_DEC_DC_LEVEL) {
+        fbn_dec_basecase(end, x, xn, 2 << k);
+        return;
+    }
+
+    const struct fbn_dec_pow *pw = &fbn_dec_pows[k];
+    fbn_limb *q = scratch, *r = q + pw->len + 2, *next = r + 2 * pw->len;
+    int qn, rn;
+    fbn_dec_divrem(q, &qn, r, &rn, x, xn, pw, next);
+
+    struct fbn_dec_task task = {
+        .end = end - (FBN_DECBASE_DIGITS << k),
+        .x = q,
+        .xn = qn,
+        .k = k - 1,
+        .cpus = cpus / 2,
+    };
+    /* the scratch of a piece below pw[k] covers the half */
+    if (cpus > 1 && pw->len >= READ_ONCE(fbn_dec_par_threshold))
+        task.scratch = kvmalloc_array(fbn_dec_scratch(pw->len),
+                                      sizeof(fbn_limb), GFP_KERNEL);
+    if (!task.scratch) {
+        fbn_dec_dc(end, r, rn, k - 1, next, 1);
+        fbn_dec_dc(task.end, q, qn, k - 1, next, 1);
+        return;
+    }
+    INIT_WORK_ONSTACK(&task.work, fbn_dec_run);
+    if (fbn_queue_work(&task.work)) {
+        fbn_dec_dc(end, r, rn, k - 1, next, cpus - task.cpus);
+        fbn_flush_work(&task.work);
+    } else {
+        fbn_dec_dc(end, r, rn, k - 1, next, 1);
+        fbn_dec_run(&task.work);
+    }
+    destroy_work_on_stack(&task.work);
+    kvfree(task.scratch);
+}
+
+/*
+ * Print x ending at @end without padding, x < the last power prepared.
+ * Return the head of the string.
+ */
+static char *fbn_dec_dc_top(char *end,
+                            const fbn_limb *x,
+                            int xn,
+                            fbn_limb *scratch)
+{
+    const struct fbn_dec_pow *pw = fbn_dec_pows;
+    int k = FBN_DEC_DC_LEVEL;
+
+    if (__fbn_cmp(x, xn, pw[k].num, pw[k].len) < 0) {
+        memcpy(scratch, x, sizeof(fbn_limb) * xn);
+        return fbn_dec_basecase(end, scratch, xn, -1);
+    }
+    /* the largest k with pw[k] <= x, so that x < pw[k + 1] = pw[k]^2 */
+    while (__fbn_cmp(x, xn, pw[k + 1].num, pw[k + 1].len) >= 0)
+        ++k;
+
+    fbn_limb *q = scratch, *r = q + pw[k].len + 2, *next = r + 2 * pw[k].len;
+    int qn, rn;
+    fbn_dec_divrem(q, &qn, r, &rn, x, xn, &pw[k], next);
+    fbn_dec_dc(end, r, rn, k - 1, next, num_online_cpus());
+    return fbn_dec_dc_top(end - (FBN_DECBASE_DIGITS << k), q, qn, next);
+}
+
+/*
+ * Print fbn into string by the divide-and-conquer conversion, the result is
+ * the same as the short division in __fbn_printv1().
+ * @arena: where the string and the temporary come from, NULL for kvmalloc
+ */
+static char *fbn_printv1_dc(const fbn *obj, struct fbn_arena *arena)
+{
+    if (unlikely(fbn_dec_pow_prepare(obj->len) < 0))
+        return NULL;
+
+    /* almost 10 digits per 32 bits */
+    size_t str_len = (size_t) (obj->len + 1) * (FBN_LIMB_BITS / 32) * 10;
+    size_t scratch_len = fbn_dec_scratch(obj->len);
+    char *str;
+    fbn_limb *scratch;
+    if (arena) {
+        str = fbn_arena_alloc(arena, str_len);
+        scratch = fbn_arena_alloc(arena, sizeof(fbn_limb) * scratch_len);
+    } else {
+        str = kvmalloc(str_len, GFP_KERNEL);
+        scratch = kvmalloc_array(scratch_len, sizeof(fbn_limb), GFP_KERNEL);
+    }
+    if (unlikely(!str || !scratch))
+        goto fail;
+    str[str_len - 1] = '\0';
+    char *str_end = str + str_len - 1;
+    char *head = fbn_dec_dc_top(str_end, obj->num, obj->len, scratch);
+
+    /* strip off the leading 0's */
+    while (head < str_end && *head == '0')
+        ++head;
+    memmove(str, head, strlen(head) + 1);
+
+    if (!arena)
+        kvfree(scratch);
+    return str;
+fail:
+    if (!arena) {
+        kvfree(scratch);
+        kvfree(str);
+    }
+    return NULL;
+}
+
+/*
+ * Decimal-native arithmetic: every limb is a digit in radix FBN_DECBASE, so
+ * the result is printed limb by limb by fbn_print_dec() without any radix
+ * conversion. Only the operations used by fbn_fib_fastdoubling_dec() exist.
+ */
+
+/* r = a + b in radix FBN_DECBASE, return the carry */
+static fbn_limb __fbn_dadd_n(fbn_limb *r,
+                             const fbn_limb *a,
+                             const fbn_limb *b,
+                             int n)
+{
+    fbn_limb carry = 0;
+    for (int i = 0; i < n; ++i) {
+        fbn_limb sum = a[i] + b[i] + carry; /* < 2 * FBN_DECBASE */
+        carry = sum >= FBN_DECBASE;
+        r[i] = carry ? sum - FBN_DECBASE : sum;
+    }
+    return carry;
+}
+
+/* r += carry in radix FBN_DECBASE, return the carry */
+static fbn_limb __fbn_dadd_1(fbn_limb *r, int n, fbn_limb carry)
+{
+    for (int i = 0; carry && i < n; ++i) {
+        r[i] += carry;
+        carry = r[i] >= FBN_DECBASE;
+        if (carry)
+            r[i] -= FBN_DECBASE;
+    }
+    return carry;
+}
+
+/* r = a - b in radix FBN_DECBASE, return the borrow */
+static fbn_limb __fbn_dsub_n(fbn_limb *r,
+                             const fbn_limb *a,
+                             const fbn_limb *b,
+                             int n)
+{
+    fbn_limb borrow = 0;
+    for (int i = 0; i < n; ++i) {
+        fbn_limb sub = b[i] + borrow;
+        borrow = a[i] < sub;
+        r[i] = a[i] - sub + (borrow ? FBN_DECBASE : 0);
+    }
+    return borrow;
+}
+
+/* r -= borrow in radix FBN_DECBASE, return the borrow */
+static fbn_limb __fbn_dsub_1(fbn_limb *r, int n, fbn_limb borrow)
+{
+    for (int i = 0; borrow && i < n; ++i) {
+        borrow = !r[i];
+        r[i] = borrow ? FBN_DECBASE - 1 : r[i] - 1;
+    }
+    return borrow;
+}
+
+/* r = a + b in radix FBN_DECBASE, where an >= bn, return the carry */
+static fbn_limb __fbn_dadd(fbn_limb *r,
+                           const fbn_limb *a,
+                           int an,
+                           const fbn_limb *b,
+                           int bn)
+{
+    fbn_limb carry = __fbn_dadd_n(r, a, b, bn);
+    if (r != a)
+        memcpy(r + bn, a + bn, sizeof(fbn_limb) * (an - bn));
+    return __fbn_dadd_1(r + bn, an - bn, carry);
+}
+
+/* r = a - b in radix FBN_DECBASE, where an >= bn, return the borrow */
+static fbn_limb __fbn_dsub(fbn_limb *r,
+                           const fbn_limb *a,
+                           int an,
+                           const fbn_limb *b,
+                           int bn)
+{
+    fbn_limb borrow = __fbn_dsub_n(r, a, b, bn);
+    if (r != a)
+        memcpy(r + bn, a + bn, sizeof(fbn_limb) * (an - bn));
+    return __fbn_dsub_1(r + bn, an - bn, borrow);
+}
+
+/*
+ * Long multiplication in radix FBN_DECBASE, r has (an + bn) limbs.
+ *
+ * Column by column, the binary products are summed into a limb-and-a-half
+ * accumulator and only divided by FBN_DECBASE once per column.
+ */
+static void __fbn_dmul_basecase(fbn_limb *r,
+                                const fbn_limb *a,
+                                int an,
+                                const fbn_limb *b,
+                                int bn)
+{
+    fbn_limb divisor = FBN_DECBASE;
+    fbn_dlimb acc = 0; /* the carry from the lower column */
+
+    for (int k = 0; k < an + bn - 1; ++k) {
+        int lo = k < bn ? 0 : k - bn + 1, hi = k < an ? k : an - 1;
+        fbn_limb over = 0;
+        for (int i = lo; i <= hi; ++i) {
+            fbn_dlimb prod = (fbn_dlimb) a[i] * b[k - i];
+            acc += prod;
+            over += acc < prod;
+        }
+        /* (over, acc) = q * FBN_DECBASE + r[k], q is the next carry */
+        fbn_limb q_high, q_low, rem;
+        divlimb(over, (fbn_limb) (acc >> FBN_LIMB_BITS), divisor, q_high, rem);
+        divlimb(rem, (fbn_limb) acc, divisor, q_low, rem);
+        r[k] = rem;
+        acc = (fbn_dlimb) q_high << FBN_LIMB_BITS | q_low;
+    }
+    r[an + bn - 1] = acc;
+}
+
+/*
+ * Scratch limbs of __fbn_dmul() with bn = @n. Every Karatsuba level takes
+ * 4 * ceil(n/2) + 4 limbs on (ceil(n/2) + 1)-limb operands, plus a product of
+ * the unbalanced pieces.
+ */
+#define FBN_DMUL_SCRATCH(n) (6 * (n) + 512)
+
+/*
+ * r = a * b in radix FBN_DECBASE, r has 2n limbs (Karatsuba).
+ * @r cannot overlap @a, @b or @scratch.
+ *
+ * The middle term is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1, so that no negative
+ * number appears in radix FBN_DECBASE.
+ */
+static void __fbn_dmul_n(fbn_limb *r,
+                         const fbn_limb *a,
+                         const fbn_limb *b,
+                         int n,
+                         fbn_limb *scratch)
+{
+    if (!fbn_kara_worth(n)) {
+        __fbn_dmul_basecase(r, a, n, b, n);
+        return;
+    }
+
+    /* a = a1 * FBN_DECBASE^h + a0, a0 has h limbs and a1 has l limbs */
+    int h = (n + 1) / 2, l = n - h, zn = 2 * h + 2;
+    fbn_limb *sa = scratch, *sb = sa + h + 1, *z1 = sb + h + 1;
+    fbn_limb *next = z1 + zn;
+
+    sa[h] = __fbn_dadd(sa, a, h, a + h, l);
+    sb[h] = __fbn_dadd(sb, b, h, b + h, l);
+    __fbn_dmul_n(z1, sa, sb, h + 1, next);
+    __fbn_dmul_n(r, a, b, h, next);
+    __fbn_dmul_n(r + 2 * h, a + h, b + h, l, next);
+    __fbn_dsub(z1, z1, zn, r, 2 * h);
+    __fbn_dsub(z1, z1, zn, r + 2 * h, 2 * l);
+    /* z1 < 2 * FBN_DECBASE^n, its limbs above r[2n] are zeros */
+    __fbn_dadd(r + h, r + h, 2 * n - h, z1, zn < 2 * n - h ? zn : 2 * n - h);
+}
+
+/*
+ * r = a * b in radix FBN_DECBASE, where an >= bn, r has (an + bn) limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least FBN_DMUL_SCRATCH(bn)
+ */
+static void __fbn_dmul(fbn_limb *r,
+                       const fbn_limb *a,
+                       int an,
+                       const fbn_limb *b,
+                       int bn,
+                       fbn_limb *scratch)
+{
+    if (!fbn_kara_worth(bn)) {
+        __fbn_dmul_basecase(r, a, an, b, bn);
+        return;
+    }
+
+    __fbn_dmul_n(r, a, b, bn, scratch);
+    /* r[bn + offset ...] += a[offset ...] * b, piece by piece */
+    fbn_limb *prod = scratch, *next = scratch + 2 * bn;
+    for (int offset = bn; offset < an; offset += bn) {
+        int pn = an - offset < bn ? an - offset : bn;
+        if (pn == bn)
+            __fbn_dmul_n(prod, a + offset, b, bn, next);
+        else
+            __fbn_dmul(prod, b, bn, a + offset, pn, next);
+        /* the limbs above r[offset + bn] have not been written yet */
+        fbn_limb carry = __fbn_dadd_n(r + offset, r + offset, prod, bn);
+        memcpy(r + offset + bn, prod + bn, sizeof(fbn_limb) * pn);
+        __fbn_dadd_1(r + offset + bn, pn, carry);
+    }
+}
+
+/*
+ * c = a + b in radix FBN_DECBASE, c += a is also acceptable.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fbn_dadd(fbn *c, fbn *a, fbn *b)
+{
+    /* a->num is always the longest one */
+    if (a->len < b->len)
+        fbn_swap(a, b);
+    if (unlikely(fbn_iszero(b)))
+        return fbn_copy(c, a) ? -ENOMEM : 0;
+
+    int len = a->len;
+    if (unlikely(fbn_reserve(c, len + 1) < 0))
+        return -ENOMEM;
+    fbn_limb carry = __fbn_dadd(c->num, a->num, len, b->num, b->len);
+    c->num[len] = carry;
+    c->len = len + carry;
+    return 0;
+}
+
+/*
+ * c = a * b in radix FBN_DECBASE, a *= b is also acceptable.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fbn_dmul(fbn *c, fbn *a, fbn *b)
+{
+    /* trivial case */
+    if (unlikely(fbn_iszero(a) || fbn_iszero(b))) {
+        fbn_set_u32(c, 0); /* c = 0 */
+        return 0;
+    }
+
+    /* a->num is always the longest one */
+    if (a->len < b->len)
+        fbn_swap(a, b);
+    int new_len = a->len + b->len;
+    struct fbn_product pd;
+    size_t work_len = fbn_kara_worth(b->len) ? FBN_DMUL_SCRATCH(b->len) : 0;
+    fbn_limb *work, *prod = fbn_product_begin(c, c == a || c == b, new_len,
+                                              work_len, c->arena, &work, &pd);
+    int rc = -ENOMEM;
+    if (unlikely(!prod))
+        goto out;
+    __fbn_dmul(prod, a->num, a->len, b->num, b->len, work);
+    fbn_product_end(c, prod, new_len);
+    rc = 0;
+out:
+    fbn_product_release(&pd);
+    return rc;
+}
+
+/*
+ * Capacity (limbs) to hold F(n) and the intermediates of the engines.
+ * F(n) has floor(n * log10(phi)) + 1 digits at most (log10(phi) = 0.20898...)
+ * and a limb in radix FBN_DECBASE holds less than a binary limb, so it is
+ * enough for both the binary and the decimal-native engines. The margin
+ * covers F(n + 1) and the untruncated products of the doubling step, e.g.
+ * (2a + b) * b, so fbn_fib_cap(k) bounds every number of the step which
+ * reaches F(k) and the engines never resize.
+ */
+int fbn_fib_cap(u64 n)
+{
+    if (unlikely(n > FBN_FIB_MAX_N))
+        n = FBN_FIB_MAX_N;
+    return ROUNDUP4((int) (n * 20899 / 100000 / FBN_DECBASE_DIGITS) + 10);
+}
+
+/* Bytes of an arena to compute and print F(n) without other allocations */
+size_t fbn_arena_size_fib(u64 n)
+{
+    int cap = fbn_fib_cap(n);
+    int half = cap / 2; /* the operands of the largest product */
+    size_t fbn_size = FBN_ARENA_ALIGN(sizeof(fbn)) +
+                      FBN_ARENA_ALIGN(sizeof(fbn_limb) * cap);
+    size_t work = fbn_mul_work_bound(half); /* >= FBN_DMUL_SCRATCH(half) */
+    size_t print = fbn_size; /* the copy in fbn_printv1_arena() */
+    if (cap >= fbn_dec_dc_threshold)
+        print += FBN_ARENA_ALIGN(sizeof(fbn_limb) * fbn_dec_scratch(cap));
+
+    /* des, two temporaries, printing and the multiplication scratch */
+    return 3 * fbn_size + print +
+           FBN_ARENA_ALIGN((size_t) (cap + 1) * (FBN_LIMB_BITS / 32) * 10) +
+           FBN_ARENA_ALIGN(sizeof(fbn_limb) * (ROUNDUP4(2 * half) + work));
+}
+
+/*
+ * Largest n whose fbn_arena_size_fib(n) is at most FBN_ARENA_MAX, found by
+ * bisection since the size grows with n.
+ */
+u64 fbn_arena_max_n(void)
+{
+    u64 lo = 0, hi = FBN_FIB_MAX_N;
+    while (lo < hi) {
+        u64 mid = lo + (hi - lo + 1) / 2;
+        if (fbn_arena_size_fib(mid) <= FBN_ARENA_MAX)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/*
+ * Allocate fbn from an arena, large enough to be the destination of the
+ * Fibonacci engines for F(n).
+ */
+fbn *fbn_alloc_fib(struct fbn_arena *arena, u64 n)
+{
+    return fbn_alloc_arena(arena, fbn_fib_cap(n));
+}
+
+/*
+ * Allocate an engine temporary of F(n)'s capacity, from @des's arena if it
+ * has one.
+ */
+static fbn *fbn_alloc_tmp(const fbn *des, u64 n)
+{
+    if (des->arena)
+        return fbn_alloc_arena(des->arena, fbn_fib_cap(n));
+    return fbn_alloc(fbn_fib_cap(n));
+}
+
+/* Start the progress of F(n), @total steps to take */
+void fbn_fib_begin(struct fbn_progress *prog, u64 n, u64 total)
+{
+    if (!prog)
+        return;
+    WRITE_ONCE(prog->n, n);
+    WRITE_ONCE(prog->done, 0);
+    WRITE_ONCE(prog->total, total);
+}
+
+/*
+ * Between two steps of an engine: yield the CPU if needed and record @done
+ * steps taken.
+ * Return -EINTR on a fatal signal or an abort asked through @prog, else 0.
+ */
+int fbn_fib_step(struct fbn_progress *prog, u64 done)
+{
+    cond_resched();
+    if (prog) {
+        WRITE_ONCE(prog->done, done);
+        if (unlikely(READ_ONCE(prog->abort)))
+            return -EINTR;
+    }
+    return unlikely(fatal_signal_pending(current)) ? -EINTR : 0;
+}
+
+/* Additions of fbn_fib_defi() and the steps of fbn_fib_batch() per check */
+#define FBN_FIB_ADD_STEP 1024
+
+/*
+ * Calculate the nth Fibonacci number with definition.
+ * @des: fbn object to store @n-th Fibonacci number
+ * @n: @n-th Fibonacci number
+ * @prog: where the additions are counted, or NULL
+ */
+int fbn_fib_defi(fbn *des, u64 n, struct fbn_progress *prog)
+{
+    if (unlikely(n > FBN_FIB_MAX_N))
+        return -EINVAL; /* would not fit in FBN_MAX_LIMBS */
+    /* trivial case */
+    if (unlikely(n <= 2)) {
+        if (n > 0)
+            fbn_set_u32(des, 1); /* des = 1 */
+        else
+            fbn_set_u32(des, 0); /* des = 0 */
+        return 0;
+    }
+
+    /* Fibonacci definition */
+    fbn *arr[2];
+    int rc = -ENOMEM;
+    arr[0] = fbn_alloc_tmp(des, n);
+    arr[1] = fbn_alloc_tmp(des, n);
+    if (unlikely(!arr[0] || !arr[1]))
+        goto fail_alloc;
+    fbn_set_u32(arr[0], 1); /* arr[0] = 1 (F_1) */
+    fbn_set_u32(arr[1], 1); /* arr[1] = 1 (F_2) */
+    fbn_fib_begin(prog, n, n - 2);
+    for (u64 i = 3; i <= n; ++i) {
+        rc = fbn_add(arr[i & 1], arr[i & 1], arr[(i - 1) & 1]);
+        if (unlikely(rc))
+            goto fail_alloc;
+        if (!(i % FBN_FIB_ADD_STEP)) {
+            rc = fbn_fib_step(prog, i - 2);
+            if (unlikely(rc))
+                goto fail_alloc;
+        }
+    }
+    rc = fbn_fib_step(prog, n - 2);
+
+    fbn_swap_content(des, arr[n & 1]);
+fail_alloc:
+    fbn_free(arr[0]);
+    fbn_free(arr[1]);
+    return rc;
+}
+
+/*
+ * Cost model of fbn_fib_batch() and the checkpoints, in limb operations.
+ * Only the basecase and Karatsuba are modelled, it is to compare the ways to
+ * reach an index, not to predict the time.
+ */
+
+/* Binary limbs of F(n), log2(phi) = 0.69424 */
+static int fbn_fib_limbs(u64 n)
+{
+    return (int) (n * 69424 / 100000 / FBN_LIMB_BITS) + 1;
+}
+
+/* Cost of multiplying @an limbs by @bn limbs */
+static u64 fbn_mul_cost(int an, int bn)
+{
+    if (an < bn) {
+        int t = an;
+        an = bn;
+        bn = t;
+    }
+    /* the balanced product of bn limbs */
+    u64 cost = 1;
+    int n = bn;
+    for (; fbn_kara_worth(n); n = (n + 1) / 2)
+        cost *= 3;
+    cost *= (u64) n * n;
+    /* the longer operand is cut into bn-limb pieces */
+    return cost * ((an + bn - 1) / bn);
+}
+
+/* Cost of fbn_fib_pair(n): one product and two squares per doubling */
+static u64 fbn_fib_cost(u64 n)
+{
+    u64 cost = 0;
+    for (; n > 1; n >>= 1) {
+        int len = fbn_fib_limbs(n / 2);
+        cost += 3 * fbn_mul_cost(len, len);
+    }
+    return cost;
+}
+
+/*
+ * Checkpoints of fast doubling. After the top bits p of n are processed the
+ * engines hold F(p - 1), F(p), so a checkpoint of that pair lets any later n
+ * with the binary prefix p skip those steps. An n close to a checkpoint k is
+ * reached by |n - k| additions instead, far cheaper than the last doubling
+ * steps which dominate. A computation keeps the pairs of its last
+ * FBN_CKPT_LEVELS prefixes, n >> 3 to n itself, which take less than twice
+ * the pair of n. The least recently used ones are dropped beyond
+ * fbn_ckpt_size bytes.
+ * [next] hash chain
+ * [k] the prefix, [num] holds F(k - 1) of [len][0] limbs then F(k) of
+ *     [len][1] limbs
+ * [stamp] fbn_ckpt_clock of the last use
+ * [size] bytes charged to fbn_ckpt_size
+ * [users] callers copying [num] outside fbn_ckpt_lock
+ * [dead] dropped while in use, the last user frees it
+ */
+struct fbn_ckpt {
+    struct fbn_ckpt *next;
+    u64 k;
+    int len[2];
+    u64 stamp;
+    size_t size;
+    int users;
+    bool dead;
+    fbn_limb num[];
+};
+#define FBN_CKPT_HASH_BITS 6
+/* Prefixes kept per computation, the earlier ones are cheap to compute */
+#define FBN_CKPT_LEVELS 4
+/* Shorter pairs are computed faster than they are looked up */
+#define FBN_CKPT_MIN_LIMBS 32
+static struct fbn_ckpt *fbn_ckpt_hash[1 << FBN_CKPT_HASH_BITS];
+/* Serializes the lookups and updates of the checkpoints, not their copies */
+static DEFINE_MUTEX(fbn_ckpt_lock);
+static size_t fbn_ckpt_bytes;
+static u64 fbn_ckpt_clock;
+
+unsigned long fbn_ckpt_size = FBN_CKPT_SIZE;
+
+static inline struct fbn_ckpt **fbn_ckpt_slot(u64 k)
+{
+    u32 h = (u32) (k ^ k >> 32) * 0x9E3779B9U;
+    return &fbn_ckpt_hash[h >> (32 - FBN_CKPT_HASH_BITS)];
+}
+
+/* Find the checkpoint of @k, call with fbn_ckpt_lock held */
+static struct fbn_ckpt *fbn_ckpt_find(u64 k)
+{
+    struct fbn_ckpt *ck = *fbn_ckpt_slot(k);
+    while (ck && ck->k != k)
+        ck = ck->next;
+    return ck;
+}
+
+/* Drop the least recently used checkpoint, call with fbn_ckpt_lock held */
+static void fbn_ckpt_evict(void)
+{
+    struct fbn_ckpt **victim = NULL;
+
+    for (int i = 0; i < (1 << FBN_CKPT_HASH_BITS); ++i) {
+        for (struct fbn_ckpt **pp = &fbn_ckpt_hash[i]; *pp;
+             pp = &(*pp)->next) {
+            if (!victim || (*pp)->stamp < (*victim)->stamp)
+                victim = pp;
+        }
+    }
+    if (unlikely(!victim))
+        return;
+    struct fbn_ckpt *ck = *victim;
+    *victim = ck->next;
+    fbn_ckpt_bytes -= ck->size;
+    if (ck->users)
+        ck->dead = true;
+    else
+        kvfree(ck);
+}
+
+/* Drop the use of @ck taken by fbn_ckpt_resume() */
+static void fbn_ckpt_put(struct fbn_ckpt *ck)
+{
+    mutex_lock(&fbn_ckpt_lock);
+    bool last = !--ck->users && ck->dead;
+    mutex_unlock(&fbn_ckpt_lock);
+    if (last)
+        kvfree(ck);
+}
+
+/* Drop every checkpoint */
+void fbn_ckpt_free(void)
+{
+    mutex_lock(&fbn_ckpt_lock);
+    while (fbn_ckpt_bytes)
+        fbn_ckpt_evict();
+    mutex_unlock(&fbn_ckpt_lock);
+}
+
+static void fbn_ckpt_save(u64 k, const fbn *a, const fbn *b);
+
+/*
+ * Resume @a = F(n - 1), @b = F(n) from the checkpoints, by the cheaper of:
+ * - doubling from the longest binary prefix p of @n kept: the caller does
+ *   the steps of the bits below p,
+ * - stepping from the nearest index k kept by |n - k| additions (or
+ *   subtractions), done here.
+ * @a, @b: fbn objects with F(n)'s capacity at least
+ * @prog: checked for an abort while stepping, or NULL
+ * Return the number of bits of @n left to the caller (0 if F(n) is reached),
+ * -1 to start from scratch: nothing is kept, or stepping ran out of memory,
+ * or -EINTR if stepping was stopped.
+ */
+static int fbn_ckpt_resume(fbn *a, fbn *b, u64 n, struct fbn_progress *prog)
+{
+    struct fbn_ckpt *best = NULL;
+    int shift = -1, bits = fls64(n) - 1;
+    /* the cost model is evaluated before taking the lock */
+    u64 prefix_cost[64];
+    for (int s = 0; s < bits; ++s)
+        prefix_cost[s] = fbn_fib_cost(n >> s);
+    u64 cost = fbn_fib_cost(n); /* from scratch */
+    /* the addition of the step is one pass over F(n) */
+    u64 limbs = fbn_fib_limbs(n);
+
+    mutex_lock(&fbn_ckpt_lock);
+    for (int s = 0; s < bits; ++s) {
+        best = fbn_ckpt_find(n >> s);
+        if (best) {
+            shift = s;
+            cost -= prefix_cost[s];
+            break;
+        }
+    }
+    if (shift) {
+        for (int i = 0; i < (1 << FBN_CKPT_HASH_BITS); ++i) {
+            for (struct fbn_ckpt *ck = fbn_ckpt_hash[i]; ck; ck = ck->next) {
+                u64 d = n > ck->k ? n - ck->k : ck->k - n;
+                u64 step = d * limbs;
+                /* a larger pair must fit in @a, @b */
+                if (step < cost && ck->len[0] <= a->cap &&
+                    ck->len[1] <= b->cap) {
+                    best = ck;
+                    shift = 0;
+                    cost = step;
+                }
+            }
+        }
+    }
+    if (best) {
+        best->stamp = ++fbn_ckpt_clock;
+        ++best->users;
+    }
+    mutex_unlock(&fbn_ckpt_lock);
+    if (!best)
+        return -1;
+
+    /* a pair in use is never changed, at most dropped */
+    memcpy(a->num, best->num, sizeof(fbn_limb) * best->len[0]);
+    memcpy(b->num, best->num + best->len[0], sizeof(fbn_limb) * best->len[1]);
+    a->len = best->len[0];
+    b->len = best->len[1];
+    u64 k = best->k;
+    fbn_ckpt_put(best);
+
+    if (k == n || shift)
+        return shift;
+    /* no bit of @n is done until the pair of @n is reached */
+    for (u64 steps = 1; k < n; ++k, ++steps) {
+        if (unlikely(fbn_add(a, a, b))) /* a = F(k + 1) */
+            return -1;
+        fbn_swap_content(a, b);
+        if (!(steps % FBN_FIB_ADD_STEP) && unlikely(fbn_fib_step(prog, 0)))
+            return -EINTR;
+    }
+    for (u64 steps = 1; k > n; --k, ++steps) {
+        if (unlikely(fbn_sub(b, b, a))) /* b = F(k - 2) */
+            return -1;
+        fbn_swap_content(a, b);
+        if (!(steps % FBN_FIB_ADD_STEP) && unlikely(fbn_fib_step(prog, 0)))
+            return -EINTR;
+    }
+    fbn_ckpt_save(n, a, b);
+    return 0;
+}
+
+/* Keep @a = F(k - 1), @b = F(k) as the checkpoint of @k */
+static void fbn_ckpt_save(u64 k, const fbn *a, const fbn *b)
+{
+    struct fbn_ckpt *ck;
+    size_t size = sizeof(*ck) + sizeof(fbn_limb) * (a->len + b->len);
+
+    if (b->len < FBN_CKPT_MIN_LIMBS || size > READ_ONCE(fbn_ckpt_size))
+        return;
+    mutex_lock(&fbn_ckpt_lock);
+    ck = fbn_ckpt_find(k);
+    if (ck)
+        ck->stamp = ++fbn_ckpt_clock;
+    mutex_unlock(&fbn_ckpt_lock);
+    if (ck)
+        return;
+
+    /* copy outside the lock, another caller may add @k meanwhile */
+    ck = kvmalloc(size, GFP_KERNEL);
+    if (unlikely(!ck))
+        return;
+    ck->k = k;
+    ck->len[0] = a->len;
+    ck->len[1] = b->len;
+    ck->size = size;
+    ck->users = 0;
+    ck->dead = false;
+    memcpy(ck->num, a->num, sizeof(fbn_limb) * a->len);
+    memcpy(ck->num + a->len, b->num, sizeof(fbn_limb) * b->len);
+
+    mutex_lock(&fbn_ckpt_lock);
+    if (unlikely(fbn_ckpt_find(k))) {
+        mutex_unlock(&fbn_ckpt_lock);
+        kvfree(ck);
+        return;
+    }
+    while (fbn_ckpt_bytes && fbn_ckpt_bytes + size > fbn_ckpt_size)
+        fbn_ckpt_evict();
+    ck->stamp = ++fbn_ckpt_clock;
+    ck->next = *fbn_ckpt_slot(k);
+    *fbn_ckpt_slot(k) = ck;
+    fbn_ckpt_bytes += size;
+    mutex_unlock(&fbn_ckpt_lock);
+}
+
+/*
+ * Calculate the nth Fibonacci number with fast doubling method.
+ * @des: fbn object to store @n-th Fibonacci number
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_fastdoubling(fbn *des, u64 n, struct fbn_progress *prog)
+{
+    if (unlikely(n > FBN_FIB_MAX_N))
+        return -EINVAL; /* would not fit in FBN_MAX_LIMBS */
+    /* trivial case */
+    if (unlikely(n <= 2)) {
+        if (n > 0)
+            fbn_set_u32(des, 1); /* des = 1 */
+        else
+            fbn_set_u32(des, 0); /* des = 0 */
+        return 0;
+    }
+
+    /* fast doubling method */
+    u64 mask = 1ULL << (fls64(n) - 1);
+    if (unlikely(fbn_reserve(des, fbn_fib_cap(n)) < 0))
+        return -ENOMEM;
+    fbn *a = des; /* a will be the result */
+    fbn *b = fbn_alloc_tmp(des, n);
+    fbn *tmp = fbn_alloc_tmp(des, n);
+    int rc = -ENOMEM;
+    if (unlikely(!b || !tmp))
+        goto fail_alloc;
+    fbn_fib_begin(prog, n, fls64(n));
+    /* a checkpoint F(p - 1), F(p) of prefix p gives a = F(p), b = F(p + 1) */
+    int shift = -1;
+    if (READ_ONCE(fbn_ckpt_size))
+        shift = fbn_ckpt_resume(a, b, n, prog);
+    if (unlikely(shift == -EINTR)) {
+        rc = -EINTR;
+        goto fail_alloc;
+    }
+    if (shift >= 0) {
+        if (unlikely(fbn_add(a, a, b)))
+            goto fail_alloc;
+        fbn_swap_content(a, b);
+        mask = (1ULL << shift) >> 1;
+    } else {
+        fbn_set_u32(a, 0); /* a = 0 */
+        fbn_set_u32(b, 1); /* b = 1 */
+    }
+    while (mask) {
+        /* times 2 */
+        rc = -ENOMEM;
+        if (unlikely(fbn_lshift31(tmp, b, 1) || /* tmp = ((b << 1) */
+                     fbn_sub(tmp, tmp, a) ||    /*        - a) */
+                     fbn_mul(tmp, tmp, a) ||    /*        * a */
+                     fbn_sqr(a, a) ||           /* a^2 */
+                     fbn_sqr(b, b) ||           /* b^2 */
+                     fbn_add(b, b, a)))         /* b = a^2 + b^2 */
+            goto fail_alloc;
+        fbn_swap_content(a, tmp); /* a <-> tmp */
+
+        /* plus 1 */
+        if (mask & n) {
+            fbn_swap_content(a, b);         /* a <-> b */
+            if (unlikely(fbn_add(b, b, a))) /* b += a */
+                goto fail_alloc;
+        }
+        rc = fbn_fib_step(prog, fls64(n) - fls64(mask) + 1);
+        if (unlikely(rc))
+            goto fail_alloc;
+        mask >>= 1;
+    }
+    rc = 0;
+
+fail_alloc:
+    fbn_free(b);
+    fbn_free(tmp);
+    return rc;
+}
+
+int fbn_par_threshold = FBN_PAR_THRESHOLD;
+
+/*
+ * One product of the parallel doubling step, run by a worker.
+ * [work] the work item on the caller's stack
+ * [c] = [a] * [b], or [a]^2 if [b] is NULL
+ * [queued] run by a worker, else by the caller
+ * [rc] the return value of the product
+ */
+struct fbn_par_task {
+    struct work_struct work;
+    fbn *c;
+    fbn *a;
+    fbn *b;
+    bool queued;
+    int rc;
+};
+
+static void fbn_par_run(struct work_struct *work)
+{
+    struct fbn_par_task *t = container_of(work, struct fbn_par_task, work);
+
+    /* never from the arena, the caller carves its own product from it */
+    if (t->b)
+        t->rc = fbn_mul_scratch(t->c, t->a, t->b, NULL);
+    else
+        t->rc = fbn_sqr_scratch(t->c, t->a, NULL);
+}
+
+static inline bool fbn_par_worth(int n)
+{
+    return n >= fbn_par_threshold && num_online_cpus() > 1;
+}
+
+/*
+ * The products of a doubling step are independent: tmp = tmp * b and a = a^2
+ * go to workers while the caller computes sq = b^2, b is left as it is. The
+ * destinations are grown here, so only the caller touches an arena.
+ * @sq: fbn object from kmalloc with F(n)'s capacity
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fbn_par_step(fbn *tmp, fbn *a, fbn *b, fbn *sq)
+{
+    struct fbn_par_task task[2] = {
+        {.c = tmp, .a = tmp, .b = b},
+        {.c = a, .a = a},
+    };
+
+    if (unlikely(fbn_reserve(tmp, tmp->len + b->len) < 0 ||
+                 fbn_reserve(a, 2 * a->len) < 0))
+        return -ENOMEM;
+    for (int i = 0; i < 2; ++i) {
+        INIT_WORK_ONSTACK(&task[i].work, fbn_par_run);
+        task[i].queued = fbn_queue_work(&task[i].work);
+    }
+    int rc = fbn_sqr(sq, b);
+    for (int i = 0; i < 2; ++i) {
+        if (task[i].queued)
+            fbn_flush_work(&task[i].work);
+        else
+            fbn_par_run(&task[i].work);
+        destroy_work_on_stack(&task[i].work);
+        if (unlikely(task[i].rc))
+            rc = task[i].rc;
+    }
+    return rc;
+}
+
+/*
+ * Fast doubling without subtraction: a = F(n - 1), b = F(n).
+ * With checkpoints enabled it resumes from them and keeps the pairs of the
+ * last FBN_CKPT_LEVELS prefixes of @n.
+ * @a, @b: fbn objects with F(n)'s capacity at least
+ * @n: n >= 2
+ * @prog: where the bits of @n are counted, or NULL
+ * Return 0, -ENOMEM or -EINTR.
+ */
+static int __fbn_fib_fastdoublingv1(fbn *a,
+                                    fbn *b,
+                                    u64 n,
+                                    struct fbn_progress *prog)
+{
+    u64 mask = 1ULL << (fls64(n) - 1 - 1);
+    bool ckpt = READ_ONCE(fbn_ckpt_size);
+    fbn_fib_begin(prog, n, fls64(n));
+    int shift = ckpt ? fbn_ckpt_resume(a, b, n, prog) : -1;
+    if (unlikely(shift == -EINTR))
+        return -EINTR;
+    if (shift >= 0) {
+        mask = (1ULL << shift) >> 1;
+    } else {
+        fbn_set_u32(a, 0); /* a = 0 */
+        fbn_set_u32(b, 1); /* b = 1 */
+    }
+    if (!mask)
+        return fbn_fib_step(prog, fls64(n));
+    fbn *tmp = fbn_alloc_tmp(b, n);
+    if (unlikely(!tmp))
+        return -ENOMEM;
+    /* b^2 of the parallel steps, outside the arena sized for serial ones */
+    fbn *sq = fbn_par_worth(fbn_fib_limbs(n) / 2) ? fbn_alloc(fbn_fib_cap(n))
+                                                  : NULL;
+    int rc = 0;
+    while (mask) {
+        /* times 2 */
+        rc = -ENOMEM;
+        if (unlikely(fbn_lshift31(tmp, a, 1) || /* tmp = ((a << 1) */
+                     fbn_add(tmp, tmp, b)))     /*        + b) */
+            break;
+        if (sq && fbn_par_worth(b->len)) {
+            if (unlikely(fbn_par_step(tmp, a, b, sq) ||
+                         fbn_add(a, a, sq))) /* a = a^2 + b^2 */
+                break;
+        } else if (unlikely(fbn_mul(tmp, tmp, b) || /*        * b */
+                            fbn_sqr(a, a) ||        /* a^2 */
+                            fbn_sqr(b, b) ||        /* b^2 */
+                            fbn_add(a, a, b))) {    /* a = a^2 + b^2 */
+            break;
+        }
+        fbn_swap_content(b, tmp); /* b <-> tmp */
+
+        /* plus 1 */
+        if (mask & n) {
+            fbn_swap_content(a, b);         /* a <-> b */
+            if (unlikely(fbn_add(b, b, a))) /* b += a */
+                break;
+        }
+        /* a = F(p - 1), b = F(p) of the prefix p = n / mask */
+        if (ckpt && mask < (1ULL << FBN_CKPT_LEVELS))
+            fbn_ckpt_save(n / mask, a, b);
+        rc = fbn_fib_step(prog, fls64(n) - fls64(mask) + 1);
+        if (unlikely(rc))
+            break;
+        mask >>= 1;
+    }
+
+    fbn_free(sq);
+    fbn_free(tmp);
+    return rc;
+}
+
+/*
+ * Calculate the nth Fibonacci number with fast doubling method.
+ * Version 1: without subtraction
+ * @des: fbn object to store @n-th Fibonacci number
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_fastdoublingv1(fbn *des, u64 n, struct fbn_progress *prog)
+{
+    if (unlikely(n > FBN_FIB_MAX_N))
+        return -EINVAL; /* would not fit in FBN_MAX_LIMBS */
+    /* trivial case */
+    if (unlikely(n <= 2)) {
+        if (n > 0)
+            fbn_set_u32(des, 1); /* des = 1 */
+        else
+            fbn_set_u32(des, 0); /* des = 0 */
+        return 0;
+    }
+
+    /* fast doubling method */
+    if (unlikely(fbn_reserve(des, fbn_fib_cap(n)) < 0))
+        return -ENOMEM;
+    fbn *a = fbn_alloc_tmp(des, n);
+    int rc = -ENOMEM;
+    if (likely(a)) /* des will be the result */
+        rc = __fbn_fib_fastdoublingv1(a, des, n, prog);
+    fbn_free(a);
+    return rc;
+}
+
+/*
+ * Calculate two consecutive Fibonacci numbers with fast doubling method
+ * (version 1), to continue the sequence by fbn_add().
+ * @f0: fbn object to store F(n)
+ * @f1: fbn object to store F(n + 1)
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_pair(fbn *f0, fbn *f1, u64 n, struct fbn_progress *prog)
+{
+    if (unlikely(n >= FBN_FIB_MAX_N))
+        return -EINVAL; /* would not fit in FBN_MAX_LIMBS */
+    /* trivial case */
+    if (unlikely(n < 2)) {
+        fbn_set_u32(f0, n > 0); /* f0 = F(n) */
+        fbn_set_u32(f1, 1);     /* f1 = 1 */
+        return 0;
+    }
+
+    if (unlikely(fbn_reserve(f0, fbn_fib_cap(n + 1)) < 0 ||
+                 fbn_reserve(f1, fbn_fib_cap(n + 1)) < 0))
+        return -ENOMEM;
+    /* f1 = F(n - 1), f0 = F(n) */
+    int rc = __fbn_fib_fastdoublingv1(f1, f0, n, prog);
+    if (likely(!rc))
+        rc = fbn_add(f1, f1, f0); /* f1 = F(n + 1) */
+    return rc;
+}
+
+/*
+ * Count the indices of fbn_fib_batch() again after fbn_fib_pair() counted
+ * the bits of its own index in @prog.
+ * @last: the largest index, @cnt: number of the indices, @i: indices reached
+ * @rc: the return value of fbn_fib_pair()
+ * Return @rc, or -EINTR if the batch has to stop.
+ */
+static int fbn_batch_resume(struct fbn_progress *prog,
+                            u64 last,
+                            int cnt,
+                            int i,
+                            int rc)
+{
+    fbn_fib_begin(prog, last, cnt);
+    return rc ? rc : fbn_fib_step(prog, i);
+}
+
+/*
+ * Calculate F(n[i]) into res[i] for every i, walking up the sorted indices.
+ * From F(m - 1), F(m) the next index m + k is reached by the cheapest of:
+ * - restart: fbn_fib_pair() from scratch,
+ * - step: k additions,
+ * - jump: F(k), F(k + 1) by fbn_fib_pair(), then
+ *         F(m + k) = F(m) * F(k + 1) + F(m - 1) * F(k)
+ *         F(m + k - 1) = F(m) * F(k) + F(m - 1) * F(k - 1)
+ * @res: fbn objects to store the results
+ * @n: the indices in ascending order
+ * @cnt: number of the indices
+ * @stats: the ways taken and their estimated cost, or NULL
+ * @prog: where the indices reached are counted, or NULL
+ * Return 0, -EINVAL, -ENOMEM or -EINTR.
+ */
+int fbn_fib_batch(fbn **res,
+                  const u64 *n,
+                  int cnt,
+                  struct fbn_batch_stats *stats,
+                  struct fbn_progress *prog)
+{
+    if (unlikely(cnt <= 0))
+        return 0;
+    if (unlikely(n[cnt - 1] >= FBN_FIB_MAX_N))
+        return -EINVAL;
+
+    int cap = fbn_fib_cap(n[cnt - 1] + 1), rc = -ENOMEM;
+    fbn *a = fbn_alloc(cap), *b = fbn_alloc(cap); /* F(m - 1), F(m) */
+    fbn *fk0 = fbn_alloc(cap), *fk1 = fbn_alloc(cap);
+    fbn *tmp = fbn_alloc(cap);
+    struct fbn_batch_stats st = {0};
+    s64 m = -1; /* no F(m) yet */
+    if (unlikely(!a || !b || !fk0 || !fk1 || !tmp))
+        goto out;
+
+    rc = 0;
+    fbn_fib_begin(prog, n[cnt - 1], cnt);
+    for (int i = 0; i < cnt; ++i) {
+        u64 target = n[i], k = target - m;
+        u64 restart = fbn_fib_cost(target), cost = restart;
+        char way = 'r';
+
+        st.cost_restart += restart;
+        if (m >= 0) {
+            u64 step = (u64) k * fbn_fib_limbs(target);
+            int mlen = fbn_fib_limbs(m), klen = fbn_fib_limbs(k);
+            u64 jump = fbn_fib_cost(k) + 4 * fbn_mul_cost(mlen, klen);
+            if (step <= cost) {
+                cost = step;
+                way = 's';
+            }
+            if (jump < cost && k > 1) {
+                cost = jump;
+                way = 'j';
+            }
+        }
+        st.cost += cost;
+
+        if (way == 'r') {
+            ++st.nrestart;
+            if (target) {
+                rc = fbn_fib_pair(a, b, target - 1, prog);
+                rc = fbn_batch_resume(prog, n[cnt - 1], cnt, i, rc);
+            } else {
+                fbn_set_u32(a, 1); /* F(-1) */
+                fbn_set_u32(b, 0);
+            }
+        } else if (way == 's') {
+            ++st.nstep;
+            for (; k > 0; --k) {
+                rc = fbn_add(a, a, b);
+                if (unlikely(rc))
+                    goto out;
+                fbn_swap_content(a, b);
+                if (!(k % FBN_FIB_ADD_STEP)) {
+                    rc = fbn_fib_step(prog, i);
+                    if (unlikely(rc))
+                        goto out;
+                }
+            }
+        } else {
+            ++st.njump;
+            rc = fbn_fib_pair(fk0, fk1, k, prog); /* F(k), F(k + 1) */
+            rc = fbn_batch_resume(prog, n[cnt - 1], cnt, i, rc);
+            if (unlikely(rc))
+                goto out;
+            rc = -ENOMEM;
+            if (unlikely(fbn_mul(tmp, b, fk1) ||
+                         fbn_mul(fk1, fk1, a) || /* F(m - 1) * F(k + 1) */
+                         fbn_mul(b, b, fk0) ||   /* b = F(m) * F(k) */
+                         fbn_mul(a, a, fk0) ||
+                         fbn_add(tmp, tmp, a) || /* F(m + k) */
+                         fbn_sub(a, fk1, a) ||   /* F(m - 1) * F(k - 1) */
+                         fbn_add(a, a, b)))      /* F(m + k - 1) */
+                goto out;
+            rc = 0;
+            fbn_swap_content(b, tmp);
+        }
+        if (unlikely(rc))
+            goto out;
+        m = target;
+        rc = -ENOMEM;
+        if (unlikely(fbn_copy(res[i], b)))
+            goto out;
+        rc = fbn_fib_step(prog, i + 1);
+        if (unlikely(rc))
+            goto out;
+    }
+out:
+    if (stats)
+        *stats = st;
+    fbn_free(a);
+    fbn_free(b);
+    fbn_free(fk0);
+    fbn_free(fk1);
+    fbn_free(tmp);
+    return rc;
+}
+
+/*
+ * Calculate the nth Fibonacci number with fast doubling method in radix
+ * FBN_DECBASE (decimal-native), print it by fbn_print_dec().
+ * @des: fbn object to store @n-th Fibonacci number
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_fastdoubling_dec(fbn *des, u64 n, struct fbn_progress *prog)
+{
+    if (unlikely(n > FBN_FIB_MAX_N))
+        return -EINVAL; /* would not fit in FBN_MAX_LIMBS */
+    /* trivial case */
+    if (unlikely(n <= 2)) {
+        if (n > 0)
+            fbn_set_u32(des, 1); /* des = 1 */
+        else
+            fbn_set_u32(des, 0); /* des = 0 */
+        return 0;
     }
 
     /* fast doubling method */
-    u32 mask = 1U << (fls((u32) n) - 1 - 1);
-    fbn *a = fbn_alloc(1);
+    u64 mask = 1ULL << (fls64(n) - 1 - 1);
+    if (unlikely(fbn_reserve(des, fbn_fib_cap(n)) < 0))
+        return -ENOMEM;
+    fbn *a = fbn_alloc_tmp(des, n);
     fbn *b = des; /* b will be the result */
-    fbn *tmp = fbn_alloc(1);
+    fbn *tmp = fbn_alloc_tmp(des, n);
+    int rc = -ENOMEM;
+    if (unlikely(!a || !tmp))
+        goto fail_alloc;
     fbn_set_u32(a, 0); /* a = 0 */
     fbn_set_u32(b, 1); /* b = 1 */
+    fbn_fib_begin(prog, n, fls64(n));
     while (mask) {
         /* times 2 */
-        fbn_lshift31(tmp, a, 1);  /* tmp = ((a << 1) */
-        fbn_add(tmp, tmp, b);     /*        + b) */
-        fbn_mul(tmp, tmp, b);     /*        * b */
-        fbn_mul(a, a, a);         /* a^2 */
-        fbn_mul(b, b, b);         /* b^2 */
-        fbn_add(a, a, b);         /* b = a^2 + b^2 */
-        fbn_swap_content(b, tmp); /* a <-> tmp */
+        rc = -ENOMEM;
+        if (unlikely(fbn_dadd(tmp, a, a) ||   /* tmp = ((a << 1) */
+                     fbn_dadd(tmp, tmp, b) || /*        + b) */
+                     fbn_dmul(tmp, tmp, b) || /*        * b */
+                     fbn_dmul(a, a, a) ||     /* a^2 */
+                     fbn_dmul(b, b, b) ||     /* b^2 */
+                     fbn_dadd(a, a, b)))      /* a = a^2 + b^2 */
+            goto fail_alloc;
+        fbn_swap_content(b, tmp); /* b <-> tmp */
 
         /* plus 1 */
         if (mask & n) {
-            fbn_swap_content(a, b); /* a <-> b */
-            fbn_add(b, b, a);       /* b += a */
+            fbn_swap_content(a, b);          /* a <-> b */
+            if (unlikely(fbn_dadd(b, b, a))) /* b += a */
+                goto fail_alloc;
         }
+        rc = fbn_fib_step(prog, fls64(n) - fls64(mask) + 1);
+        if (unlikely(rc))
+            goto fail_alloc;
         mask >>= 1;
     }
+    rc = 0;
 
+fail_alloc:
     fbn_free(a);
     fbn_free(tmp);
+    return rc;
 }
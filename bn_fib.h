@@ -1,14 +1,74 @@
 #ifndef __FBN_H_
 #define __FBN_H_
 
+#ifdef __KERNEL__
+#include <linux/atomic.h>
+#include <linux/cpumask.h> /* num_online_cpus() */
+#include <linux/kernel.h>  /* INT_MAX */
+#include <linux/mutex.h>
+#include <linux/sched.h>        /* cond_resched() */
+#include <linux/sched/signal.h> /* fatal_signal_pending() */
 #include <linux/slab.h>
 #include <linux/string.h> /* memset() */
 #include <linux/types.h>
+#include <linux/workqueue.h>
+#else
+#include "bn_user.h" /* user space build for testing */
+#endif
 
 /*
- * [num] points to an array, every elements are 4-byte,
- *       so storing a big number larger than 4 bytes will
- *       be like bellow:
+ * Limb (element of fbn's num) type.
+ *
+ * On 64-bit kernels with a compiler supporting unsigned __int128, every limb
+ * is 8-byte and products/carries are accumulated in 128 bits. Otherwise (or
+ * when built with KCFLAGS=-DFBN_LIMB32) limbs are 4-byte with 64-bit carries.
+ *
+ * [fbn_limb] the type of one element of fbn's num
+ * [fbn_dlimb] the double-width type to hold a limb product plus carries
+ */
+#if defined(CONFIG_64BIT) && defined(__SIZEOF_INT128__) && !defined(FBN_LIMB32)
+typedef u64 fbn_limb;
+typedef unsigned __int128 fbn_dlimb;
+#define FBN_LIMB_SHIFT 6
+#define fbn_fls(x) fls64(x)
+#else
+typedef u32 fbn_limb;
+typedef u64 fbn_dlimb;
+#define FBN_LIMB_SHIFT 5
+#define fbn_fls(x) fls(x)
+#endif
+/* bits per limb */
+#define FBN_LIMB_BITS (1U << FBN_LIMB_SHIFT)
+/*
+ * Most limbs of one fbn (512 MiB of 64-bit limbs), so the int limb counts of
+ * the multiplication scratch, a few times the operands, cannot overflow.
+ */
+#define FBN_MAX_LIMBS (1 << 26)
+/*
+ * Largest n the Fibonacci engines take, F(n) and the intermediates fit in
+ * FBN_MAX_LIMBS decimal-native limbs (n * log10(phi) / 9 limbs per 32 bits).
+ */
+#define FBN_FIB_MAX_N ((u64) (FBN_MAX_LIMBS - 16) * (FBN_LIMB_BITS / 32) * 43)
+/* NTT multiplication (bn_ntt.c) needs 64 x 64 -> 128-bit products */
+#if defined(CONFIG_64BIT) && defined(__SIZEOF_INT128__)
+#define FBN_HAVE_NTT
+#endif
+
+/*
+ * Bump allocator for one computation: all fbn objects and temporaries are
+ * carved from one region and released together by fbn_arena_destroy().
+ * [base] the region, [size] its length in bytes
+ * [used] bytes handed out so far
+ */
+struct fbn_arena {
+    char *base;
+    size_t size;
+    size_t used;
+};
+
+/*
+ * [num] points to an array, every elements are a limb (4-byte shown below),
+ *       so storing a big number larger than a limb will be like bellow:
  *
  * 0xba98'7654'3210 => | 76543210 | 0000ba98 | ... |
  *                           ^          ^
@@ -17,11 +77,14 @@
  * [len] is the length of array with valid value elements
  *       i.e. allocated array length - #(leading zero elements)
  * [cap] is the allocated array length
+ * [arena] is the arena which num (and the fbn itself) is carved from, or NULL
+ *         if they are from kvmalloc (num) and kmalloc
  */
 typedef struct {
-    u32 *num;
+    fbn_limb *num;
     int len;
     int cap;
+    struct fbn_arena *arena;
 } fbn;
 
 /*
@@ -33,6 +96,39 @@ fbn *fbn_alloc(int cap);
 /* Free fbn, return 0 on success and -1 on failure */
 int fbn_free(fbn *obj);
 
+/* Largest arena, kvmalloc() refuses more than INT_MAX bytes */
+#define FBN_ARENA_MAX ((size_t) INT_MAX)
+
+/*
+ * Allocate @size bytes to an arena.
+ * Return 0 on success and -1 on failure or if @size > FBN_ARENA_MAX.
+ */
+int fbn_arena_init(struct fbn_arena *arena, size_t size);
+/* Release the arena and every fbn carved from it */
+void fbn_arena_destroy(struct fbn_arena *arena);
+/* Bytes of an arena to compute and print F(n) without other allocations */
+size_t fbn_arena_size_fib(u64 n);
+/* Largest n whose fbn_arena_size_fib(n) is at most FBN_ARENA_MAX */
+u64 fbn_arena_max_n(void);
+/*
+ * Allocate fbn from an arena, fbn_free() on it is a no-op.
+ * @cap: the length of fbn's num alloc
+ * Return fbn with length round-up4(@cap) and num is all zeros.
+ */
+fbn *fbn_alloc_arena(struct fbn_arena *arena, int cap);
+/*
+ * Capacity (limbs) to hold F(n) in binary or decimal-native radix, enough for
+ * every intermediate of the engines' doubling steps which reach F(k) with
+ * k <= n as well.
+ */
+int fbn_fib_cap(u64 n);
+/*
+ * Allocate fbn from an arena, large enough to be the destination of the
+ * Fibonacci engines for F(n). The engines then take their temporaries and
+ * the multiplication scratch from the same arena.
+ */
+fbn *fbn_alloc_fib(struct fbn_arena *arena, u64 n);
+
 /*
  * Assign a 32-bits value to fbn.
  * @obj: fbn object
@@ -51,49 +147,270 @@ int fbn_copy(fbn *des, const fbn *src);
 /* Print fbn in hex (Debug: use dmesg) */
 void fbndebug_printhex(const fbn *obj);
 #endif /* _FBN_DEBUG */
-/* Print fbn to string (decimal), need kfree to free this string */
+/* Print fbn to string (decimal), need kvfree to free this string */
 char *fbn_print(const fbn *obj);
-/* Print fbn into string (version 1), need kfree to free the string */
+/* Print fbn into string (version 1), need kvfree to free the string */
 char *fbn_printv1(const fbn *obj);
+/* Print fbn into string (version 1), the string is carved from @arena */
+char *fbn_printv1_arena(const fbn *obj, struct fbn_arena *arena);
+/*
+ * Print decimal-native fbn (fbn_fib_fastdoubling_dec()) into string,
+ * need kvfree to free the string.
+ */
+char *fbn_print_dec(const fbn *obj);
+/* Print decimal-native fbn into string carved from @arena */
+char *fbn_print_dec_arena(const fbn *obj, struct fbn_arena *arena);
+/*
+ * Bytes to store binary fbn in raw format: little-endian, without leading
+ * zero bytes, zero takes one byte.
+ */
+size_t fbn_raw_size(const fbn *obj);
+/* Store binary fbn into @buf in raw format, fbn_raw_size() bytes */
+void fbn_to_raw(const fbn *obj, u8 *buf);
+/* Bytes to print binary fbn in hex, including the terminating '\0' */
+size_t fbn_hex_size(const fbn *obj);
+/* Print binary fbn into @buf in lowercase hex, fbn_hex_size() bytes */
+void fbn_to_hex(const fbn *obj, char *buf);
+
+/*
+ * The arithmetic below returns 0 on success and -ENOMEM if the result cannot
+ * grow (out of memory, the arena exhausted or beyond FBN_MAX_LIMBS). The
+ * result is garbage then, the operands are left as they are unless they are
+ * the result as well.
+ */
 
 /*
  * Left-shift under 31 bits: b = a << k. a <<= k is also acceptable.
  * @b: fbn object to store the result
  * @a: fbn object to be shifted
- * @k: shift @k bits, k %= 32
+ * @k: shift @k bits, 0 <= k < 32
  */
-void fbn_lshift31(fbn *b, fbn *a, int k);
+int fbn_lshift31(fbn *b, fbn *a, int k);
 /*
  * Left-shift (general): obj->num <<= k
  * @obj: fbn object, num cannot be 0
  * @k: shift @k bits (no limit)
  */
-void fbn_lshift(fbn *obj, int k);
+int fbn_lshift(fbn *obj, int k);
 /* c = a + b, addition assignment (c += a) is also acceptable */
-void fbn_add(fbn *c, fbn *a, fbn *b);
+int fbn_add(fbn *c, fbn *a, fbn *b);
 /* c = a - b, where a >= b. a -= b is also acceptable */
-void fbn_sub(fbn *c, fbn *a, fbn *b);
-/* c = a * b (long multiplication). a *= b is also acceptable */
-void fbn_mul(fbn *c, fbn *a, fbn *b);
+int fbn_sub(fbn *c, fbn *a, fbn *b);
+/*
+ * c = a * b. a *= b is also acceptable.
+ * Long multiplication, Karatsuba, Toom-3 or NTT is chosen by the operand
+ * length.
+ */
+int fbn_mul(fbn *c, fbn *a, fbn *b);
+/* c = a^2 (basecase, Karatsuba, Toom-3 or NTT). a = a^2 is also acceptable */
+int fbn_sqr(fbn *c, fbn *a);
+
+/* Default limb threshold to switch fbn_mul() to Karatsuba */
+#define FBN_KARATSUBA_THRESHOLD 32
+/* Default limb threshold to switch fbn_sqr() to Karatsuba squaring */
+#define FBN_KARATSUBA_SQR_THRESHOLD 48
+/* Default limb threshold to switch fbn_mul() to Toom-3 */
+#define FBN_TOOM3_THRESHOLD 128
+/* Default limb threshold to switch fbn_sqr() to Toom-3 squaring */
+#define FBN_TOOM3_SQR_THRESHOLD 160
+/* Limb threshold to switch fbn_mul() to Karatsuba, set before computing */
+extern int fbn_karatsuba_threshold;
+/* Limb threshold to switch fbn_sqr() to Karatsuba, set before computing */
+extern int fbn_karatsuba_sqr_threshold;
+/* Limb threshold to switch fbn_mul() to Toom-3, set before computing */
+extern int fbn_toom3_threshold;
+/* Limb threshold to switch fbn_sqr() to Toom-3, set before computing */
+extern int fbn_toom3_sqr_threshold;
+#ifdef FBN_HAVE_NTT
+/* Default limb threshold to switch fbn_mul() and fbn_sqr() to NTT */
+#define FBN_NTT_THRESHOLD 4096
+/* Limb threshold to switch fbn_mul() and fbn_sqr() to NTT */
+extern int fbn_ntt_threshold;
+/* Default CPUs of one NTT product, 1 keeps every product on one CPU */
+#define FBN_MUL_WORKERS 4
+/* Most CPUs of one NTT product */
+#define FBN_MUL_MAX_WORKERS 16
+/* Default limbs of the shorter operand to multiply on several CPUs */
+#define FBN_MUL_GRAIN 16384
+/*
+ * CPUs (the caller and workers of the fbn_wq_init() queue) one NTT product or
+ * square may use, at most the online ones and FBN_MUL_MAX_WORKERS. The
+ * transforms are cut by the butterflies or into blocks, and the CRT into
+ * bands whose carries are added afterwards.
+ */
+extern int fbn_mul_workers;
+/* Limbs of the shorter operand below which a product stays on one CPU */
+extern int fbn_mul_grain;
+#endif
+/* Release the scratch area kept by fbn_mul() */
+void fbn_scratch_free(void);
+
+/*
+ * Most work items of the parallel paths below queued or running at once,
+ * the max_active of their workqueue
+ */
+#define FBN_WQ_MAX_ACTIVE 64
+/*
+ * Create the workqueue of the parallel paths, every part runs on the
+ * caller's CPU without it.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+int fbn_wq_init(void);
+/* Wait for the workqueue of the parallel paths and destroy it */
+void fbn_wq_destroy(void);
+/*
+ * Queue a part of a parallel path, only if a worker takes it at once: a part
+ * may queue parts of its own and wait for them, so no part is ever left
+ * waiting behind FBN_WQ_MAX_ACTIVE busy ones.
+ * Return false if it is not queued, then the caller runs it itself.
+ */
+bool fbn_queue_work(struct work_struct *work);
+/* Wait for a part queued by fbn_queue_work() */
+void fbn_flush_work(struct work_struct *work);
+
+/* Default limb threshold to run the products of a doubling step in parallel */
+#define FBN_PAR_THRESHOLD 1024
+/*
+ * Limb threshold to run the three products of a doubling step of
+ * fbn_fib_fastdoublingv1(), fbn_fib_pair() and fbn_fib_batch() on three CPUs
+ * (two workers of the fbn_wq_init() queue and the caller). The steps are serial
+ * below it or with one CPU online.
+ */
+extern int fbn_par_threshold;
+
+/* Default limb threshold to switch fbn_printv1() to divide-and-conquer */
+#define FBN_DEC_DC_THRESHOLD 64
+/* Limb threshold to switch fbn_printv1() to divide-and-conquer */
+extern int fbn_dec_dc_threshold;
+/* Default limb threshold to print the halves of a piece on two CPUs */
+#define FBN_DEC_PAR_THRESHOLD 2048
+/*
+ * Limb threshold of the divisor to print the high half of a piece on a
+ * worker of the fbn_wq_init() queue while the caller prints the low half, until
+ * every online CPU has a piece. The string is the same as the serial one.
+ */
+extern int fbn_dec_par_threshold;
+/* Release the power table kept by fbn_printv1() */
+void fbn_dec_pow_free(void);
+
+/* Default bytes of the fast doubling checkpoints, 0 disables them */
+#define FBN_CKPT_SIZE 0
+/*
+ * Bytes kept of F(k - 1), F(k) pairs reached by fbn_fib_fastdoublingv1() and
+ * fbn_fib_pair(): k = n and the prefixes n >> 1 to n >> 3 on the way. They
+ * and fbn_fib_fastdoubling() resume from the longest binary prefix of n kept,
+ * or by additions from a kept index close to n.
+ */
+extern unsigned long fbn_ckpt_size;
+/* Release the checkpoints of fast doubling */
+void fbn_ckpt_free(void);
+
+/*
+ * Progress of an engine, written at every step and readable by other threads
+ * at any time.
+ * [n] the index being computed, the largest one of fbn_fib_batch() (that
+ *     of fbn_fib_pair() while the batch restarts or jumps)
+ * [done], [total] steps taken and to take: bits of n for the doubling
+ *                 engines, additions for fbn_fib_defi(), indices for
+ *                 fbn_fib_batch()
+ * [abort] set by another thread to stop the engine at the next step
+ */
+struct fbn_progress {
+    u64 n;
+    u64 done;
+    u64 total;
+    bool abort;
+};
+/* Start the progress of F(n), @total steps to take, @prog may be NULL */
+void fbn_fib_begin(struct fbn_progress *prog, u64 n, u64 total);
+/*
+ * Between two steps of a long computation: yield the CPU if needed and
+ * record @done steps taken.
+ * Return -EINTR on a fatal signal or an abort asked through @prog, else 0.
+ */
+int fbn_fib_step(struct fbn_progress *prog, u64 done);
+
+/*
+ * The engines below take n <= FBN_FIB_MAX_N (n < FBN_FIB_MAX_N for
+ * fbn_fib_pair() and fbn_fib_batch()) and fail with -EINVAL beyond that,
+ * leaving the destination untouched.
+ *
+ * Between two steps they yield the CPU if needed, and they stop with -EINTR
+ * on a fatal signal of the caller or an abort asked through @prog, freeing
+ * their temporaries. The destination is garbage then, as on -ENOMEM.
+ * Return 0, -EINVAL, -ENOMEM or -EINTR.
+ */
 
 /*
  * Calculate the nth Fibonacci number with definition.
  * @des: fbn object to store @n-th Fibonacci number
  * @n: @n-th Fibonacci number
+ * @prog: where the additions are counted, or NULL
  */
-void fbn_fib_defi(fbn *des, int n);
+int fbn_fib_defi(fbn *des, u64 n, struct fbn_progress *prog);
 /*
  * Calculate the nth Fibonacci number with fast doubling method.
  * @des: fbn object to store @n-th Fibonacci number
  * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
  */
-void fbn_fib_fastdoubling(fbn *des, int n);
+int fbn_fib_fastdoubling(fbn *des, u64 n, struct fbn_progress *prog);
 /*
  * Calculate the nth Fibonacci number with fast doubling method.
  * Version 1: without subtraction
  * @des: fbn object to store @n-th Fibonacci number
  * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_fastdoublingv1(fbn *des, u64 n, struct fbn_progress *prog);
+/*
+ * Calculate two consecutive Fibonacci numbers with fast doubling method,
+ * F(n + 2), F(n + 3), ... follow by fbn_add().
+ * @f0: fbn object to store F(n)
+ * @f1: fbn object to store F(n + 1)
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
+ */
+int fbn_fib_pair(fbn *f0, fbn *f1, u64 n, struct fbn_progress *prog);
+
+/*
+ * How fbn_fib_batch() reaches its indices.
+ * [nrestart], [nstep], [njump] number of the indices reached by each way
+ * [cost] estimated cost (limb operations) of the ways taken
+ * [cost_restart] estimated cost if every index restarted from scratch
+ */
+struct fbn_batch_stats {
+    u64 nrestart;
+    u64 nstep;
+    u64 njump;
+    u64 cost;
+    u64 cost_restart;
+};
+/*
+ * Calculate many Fibonacci numbers, each one from the previous one by the
+ * addition formula, by additions or from scratch, whichever is estimated
+ * cheaper.
+ * @res: fbn objects to store F(n[0]), F(n[1]), ...
+ * @n: the indices in ascending order
+ * @cnt: number of the indices
+ * @stats: where the ways taken are counted, or NULL
+ * @prog: where the indices reached are counted, or NULL
+ * It stops with -EINTR on a fatal signal or an abort like the engines.
+ * Return 0, -EINVAL, -ENOMEM or -EINTR.
+ */
+int fbn_fib_batch(fbn **res,
+                  const u64 *n,
+                  int cnt,
+                  struct fbn_batch_stats *stats,
+                  struct fbn_progress *prog);
+/*
+ * Calculate the nth Fibonacci number with fast doubling method.
+ * Decimal-native: @des is in radix 10^18 (10^9 for 32-bit limbs), so it is
+ * printed by fbn_print_dec() without radix conversion.
+ * @des: fbn object to store @n-th Fibonacci number
+ * @n: @n-th Fibonacci number
+ * @prog: where the bits of @n are counted, or NULL
  */
-void fbn_fib_fastdoublingv1(fbn *des, int n);
+int fbn_fib_fastdoubling_dec(fbn *des, u64 n, struct fbn_progress *prog);
 
 #endif /* __FBN_H_ */
@@ -0,0 +1,620 @@
+#include "bn_ntt.h"
+
+#ifdef FBN_HAVE_NTT
+
+typedef unsigned __int128 u128;
+
+/* Number of primes for CRT */
+#define NTT_NPRIMES 3
+/* Every prime is c * 2^NTT_MAXLOG + 1, so the transform length <= 2^46 */
+#define NTT_MAXLOG 46
+/* 3 is a primitive root of every prime below */
+#define NTT_GENERATOR 3
+
+/* NTT-friendly primes, all in (2^62, 2^63), and p0 > p1 > p2 */
+static const u64 ntt_primes[NTT_NPRIMES] = {
+    0x7fe7c00000000001ULL, /* 130975 * 2^46 + 1 */
+    0x7fe4c00000000001ULL, /* 130963 * 2^46 + 1 */
+    0x7fe1000000000001ULL, /* 130948 * 2^46 + 1 */
+};
+
+/*
+ * Montgomery arithmetic modulo p with R = 2^64.
+ * [p] the prime
+ * [pinv] -p^(-1) mod R
+ * [one] R mod p, i.e. 1 in Montgomery form
+ * [r2] R^2 mod p, to convert a number into Montgomery form
+ */
+struct ntt_mont {
+    u64 p;
+    u64 pinv;
+    u64 one;
+    u64 r2;
+};
+
+/* t * R^(-1) mod p, where t < p * R */
+static inline u64 mont_redc(const struct ntt_mont *m, u128 t)
+{
+    u64 q = (u64) t * m->pinv;
+    u64 res = (t + (u128) q * m->p) >> 64;
+    return res >= m->p ? res - m->p : res;
+}
+
+/* a * b * R^(-1) mod p, so a * (b in Montgomery form) = a * b mod p */
+static inline u64 mont_mul(const struct ntt_mont *m, u64 a, u64 b)
+{
+    return mont_redc(m, (u128) a * b);
+}
+
+/* (a + b) mod p */
+static inline u64 mod_add(const struct ntt_mont *m, u64 a, u64 b)
+{
+    u64 s = a + b; /* no overflow since p < 2^63 */
+    return s >= m->p ? s - m->p : s;
+}
+
+/* (a - b) mod p */
+static inline u64 mod_sub(const struct ntt_mont *m, u64 a, u64 b)
+{
+    return a >= b ? a - b : a - b + m->p;
+}
+
+/* Convert a (< p) into Montgomery form */
+static inline u64 mont_from(const struct ntt_mont *m, u64 a)
+{
+    return mont_mul(m, a, m->r2);
+}
+
+/* base^e, where base and the result are in Montgomery form */
+static u64 mont_pow(const struct ntt_mont *m, u64 base, u64 e)
+{
+    u64 res = m->one;
+    for (; e; e >>= 1) {
+        if (e & 1)
+            res = mont_mul(m, res, base);
+        base = mont_mul(m, base, base);
+    }
+    return res;
+}
+
+static void ntt_mont_init(struct ntt_mont *m, u64 p)
+{
+    /* Newton iteration, every step doubles the correct low bits of p^(-1) */
+    u64 inv = p; /* p * p = 1 (mod 8) */
+    for (int i = 0; i < 5; ++i)
+        inv *= 2 - p * inv;
+    m->p = p;
+    m->pinv = -inv;
+    m->one = -p % p;
+    /* R^2 = R * 2^64 */
+    m->r2 = m->one;
+    for (int i = 0; i < 64; ++i)
+        m->r2 = mod_add(m, m->r2, m->r2);
+}
+
+/* A primitive 2^logn-th root of unity (Montgomery form) */
+static u64 ntt_root(const struct ntt_mont *m, int logn)
+{
+    return mont_pow(m, mont_from(m, NTT_GENERATOR), (m->p - 1) >> logn);
+}
+
+/* Fill tw[i] = w^i (Montgomery form), lo <= i < hi */
+static void ntt_twiddles_range(const struct ntt_mont *m,
+                               u64 *tw,
+                               u64 w,
+                               size_t lo,
+                               size_t hi)
+{
+    if (lo >= hi)
+        return;
+    tw[lo] = mont_pow(m, w, lo);
+    for (size_t i = lo + 1; i < hi; ++i)
+        tw[i] = mont_mul(m, tw[i - 1], w);
+}
+
+/*
+ * Fill the twiddle table tw[i] = w^i (Montgomery form), 0 <= i < n / 2,
+ * where w is a primitive n-th root of unity.
+ */
+static void ntt_twiddles(const struct ntt_mont *m, u64 *tw, int logn)
+{
+    ntt_twiddles_range(m, tw, ntt_root(m, logn), 0, (size_t) 1 << (logn - 1));
+}
+
+/*
+ * One stage of the forward transform, the butterflies of distance h: the
+ * butterflies [j0, j1) of the blocks of 2h elements starting in [s0, s1).
+ */
+static void ntt_forward_stage(const struct ntt_mont *m,
+                              u64 *x,
+                              const u64 *tw,
+                              int logn,
+                              size_t h,
+                              size_t s0,
+                              size_t s1,
+                              size_t j0,
+                              size_t j1)
+{
+    size_t stride = ((size_t) 1 << (logn - 1)) / h;
+    for (size_t s = s0; s < s1; s += h << 1) {
+        for (size_t j = j0; j < j1; ++j) {
+            u64 u = x[s + j], v = x[s + j + h];
+            x[s + j] = mod_add(m, u, v);
+            x[s + j + h] = mont_mul(m, mod_sub(m, u, v), tw[j * stride]);
+        }
+    }
+}
+
+/*
+ * Forward transform (decimation in frequency).
+ * The input is in natural order and the output is in bit-reversed order.
+ */
+static void ntt_forward(const struct ntt_mont *m,
+                        u64 *x,
+                        const u64 *tw,
+                        int logn)
+{
+    size_t n = (size_t) 1 << logn;
+    for (size_t h = n >> 1; h; h >>= 1)
+        ntt_forward_stage(m, x, tw, logn, h, 0, n, 0, h);
+}
+
+/* One stage of the inverse transform, on the butterflies like above */
+static void ntt_inverse_stage(const struct ntt_mont *m,
+                              u64 *x,
+                              const u64 *tw,
+                              int logn,
+                              size_t h,
+                              size_t s0,
+                              size_t s1,
+                              size_t j0,
+                              size_t j1)
+{
+    size_t half = (size_t) 1 << (logn - 1), stride = half / h;
+    if (j0 >= j1)
+        return;
+    for (size_t s = s0; s < s1; s += h << 1) {
+        size_t j = j0;
+        u64 u, v;
+        if (!j) {
+            /* j = 0, the twiddle is 1 */
+            u = x[s], v = x[s + h];
+            x[s] = mod_add(m, u, v);
+            x[s + h] = mod_sub(m, u, v);
+            j = 1;
+        }
+        for (; j < j1; ++j) {
+            u = x[s + j];
+            /* v = -(x * w^(-j * stride)) */
+            v = mont_mul(m, x[s + j + h], tw[half - j * stride]);
+            x[s + j] = mod_sub(m, u, v);
+            x[s + j + h] = mod_add(m, u, v);
+        }
+    }
+}
+
+/*
+ * Inverse transform (decimation in time) without the 1/n scaling.
+ * The input is in bit-reversed order and the output is in natural order.
+ * w^(-i) = -w^(n/2 - i), so the forward twiddle table is reused.
+ */
+static void ntt_inverse(const struct ntt_mont *m,
+                        u64 *x,
+                        const u64 *tw,
+                        int logn)
+{
+    size_t n = (size_t) 1 << logn;
+    for (size_t h = 1; h < n; h <<= 1)
+        ntt_inverse_stage(m, x, tw, logn, h, 0, n, 0, h);
+}
+
+/* Load x[lo .. hi) of a transform from n limbs, padded with zeros */
+static void ntt_load_range(const struct ntt_mont *m,
+                           u64 *x,
+                           const fbn_limb *a,
+                           int n,
+                           size_t lo,
+                           size_t hi)
+{
+    size_t i = lo, end = hi < (size_t) n ? hi : (size_t) n;
+    for (; i < end; ++i)
+        x[i] = a[i] % m->p;
+    if (i < hi)
+        memset(x + i, 0, sizeof(u64) * (hi - i));
+}
+
+/* Load n limbs into a transform of length 2^logn, padded with zeros */
+static void ntt_load(const struct ntt_mont *m,
+                     u64 *x,
+                     const fbn_limb *a,
+                     int n,
+                     int logn)
+{
+    ntt_load_range(m, x, a, n, 0, (size_t) 1 << logn);
+}
+
+/* The smallest logn such that 2^logn >= n */
+static int ntt_log(int n)
+{
+    int logn = 1;
+    while (((size_t) 1 << logn) < (size_t) n)
+        ++logn;
+    return logn;
+}
+
+/*
+ * Scratch limbs needed by fbn_ntt_mul() or fbn_ntt_sqr().
+ * @an, @bn: the operand lengths, @bn = 0 for squaring
+ *
+ * One residue array per prime, one more for the second operand (unless
+ * squaring) and the twiddle table.
+ */
+size_t fbn_ntt_scratch(int an, int bn)
+{
+    size_t len = (size_t) 1 << ntt_log(an + (bn ? bn : an));
+    size_t words = (NTT_NPRIMES + !!bn) * len + len / 2;
+    return words * (sizeof(u64) / sizeof(fbn_limb));
+}
+
+/*
+ * Combine the residues of the coefficients lo <= i < hi by CRT (Garner's
+ * algorithm) and carry them into r[lo .. hi).
+ *   x = r0 + p0 * t1 + p0 * p1 * t2, where
+ *   t1 = (r1 - r0) / p0 mod p1
+ *   t2 = (r2 - r0 - p0 * t1) / (p0 * p1) mod p2
+ * @carry: return the 192-bit carry out of r[hi - 1], to add from r[hi] on
+ */
+static void ntt_crt(fbn_limb *r,
+                    int lo,
+                    int hi,
+                    u64 *const res[NTT_NPRIMES],
+                    u64 carry[3])
+{
+    struct ntt_mont m1, m2;
+    ntt_mont_init(&m1, ntt_primes[1]);
+    ntt_mont_init(&m2, ntt_primes[2]);
+    const u64 p0 = ntt_primes[0], p1 = ntt_primes[1];
+    /* constants in Montgomery form */
+    u64 inv_p0 = mont_pow(&m1, mont_from(&m1, p0 % p1), p1 - 2);
+    u64 p0_m2 = mont_from(&m2, p0 % m2.p);
+    u64 p01_m2 = mont_mul(&m2, p0_m2, mont_from(&m2, p1 % m2.p));
+    u64 inv_p01 = mont_pow(&m2, p01_m2, m2.p - 2);
+    /* p0 * p1 in 128 bits */
+    u128 p01 = (u128) p0 * p1;
+    u64 p01_lo = p01, p01_hi = p01 >> 64;
+
+    /* 192-bit accumulator acc2:acc1:acc0 */
+    u64 acc0 = 0, acc1 = 0, acc2 = 0;
+    for (int i = lo; i < hi; ++i) {
+        u64 r0 = res[0][i], r1 = res[1][i], r2 = res[2][i];
+        u64 t1 = mont_mul(&m1, mod_sub(&m1, r1, r0 % p1), inv_p0);
+        u64 t1_m2 = t1 % m2.p;
+        u64 u = mod_add(&m2, r0 % m2.p, mont_mul(&m2, t1_m2, p0_m2));
+        u64 t2 = mont_mul(&m2, mod_sub(&m2, r2, u), inv_p01);
+
+        /* acc += r0 + p0 * t1 + (p01_hi:p01_lo) * t2 */
+        u128 lo = (u128) p0 * t1 + r0;
+        u128 mid = (u128) p01_lo * t2;
+        u128 hi = (u128) p01_hi * t2;
+        u128 s = (u128) acc0 + (u64) lo + (u64) mid;
+        acc0 = s;
+        s = (s >> 64) + acc1 + (u64) (lo >> 64) + (u64) (mid >> 64) + (u64) hi;
+        acc1 = s;
+        acc2 += (u64) (s >> 64) + (u64) (hi >> 64);
+
+        /* emit a limb */
+        r[i] = acc0;
+#if FBN_LIMB_BITS == 64
+        acc0 = acc1, acc1 = acc2, acc2 = 0;
+#else
+        acc0 = acc0 >> 32 | acc1 << 32;
+        acc1 = acc1 >> 32 | acc2 << 32;
+        acc2 >>= 32;
+#endif
+    }
+    carry[0] = acc0;
+    carry[1] = acc1;
+    carry[2] = acc2;
+}
+
+/* r[lo ..] += the 192-bit carry of ntt_crt(), the sum fits in rn limbs */
+static void ntt_add_carry(fbn_limb *r, int lo, int rn, const u64 carry[3])
+{
+    fbn_dlimb sum = 0;
+    for (int bit = 0, i = lo; i < rn; bit += FBN_LIMB_BITS, ++i) {
+        if (bit < 192)
+            sum += (fbn_limb) (carry[bit / 64] >> (bit % 64));
+        else if (!sum)
+            break;
+        sum += r[i];
+        r[i] = sum;
+        sum >>= FBN_LIMB_BITS;
+    }
+}
+
+/*
+ * A product on several CPUs: every phase is cut into [nr] parts, part 0 is
+ * run by the caller and the others by workers of fbn_queue_work(), or by the
+ * caller as well once the workqueue is busy.
+ * [phase] the phase being run
+ * [m], [x], [y], [tw], [logn] the transforms of one prime, [y] is NULL for
+ *                             squaring
+ * [w] the root of unity of the twiddles, [inv_len] the scale of the product
+ * [a], [an], [b], [bn] the operands
+ * [h] the stage of ntt_par_top_fwd() and ntt_par_top_inv()
+ * [bs] the block of ntt_par_blocks(), shorter stages stay within a block
+ * [r], [rn], [res] the CRT of ntt_par_crt(), part p returns its carry in
+ *                  [carry][p]
+ */
+struct ntt_par {
+    void (*phase)(struct ntt_par *par, int part);
+    int nr;
+    const struct ntt_mont *m;
+    u64 *x;
+    u64 *y;
+    u64 *tw;
+    int logn;
+    u64 w;
+    u64 inv_len;
+    const fbn_limb *a;
+    const fbn_limb *b;
+    int an;
+    int bn;
+    size_t h;
+    size_t bs;
+    fbn_limb *r;
+    int rn;
+    u64 **res;
+    u64 (*carry)[3];
+};
+
+/* One part of a phase on a worker, [queued] unless the caller runs it */
+struct ntt_part {
+    struct work_struct work;
+    struct ntt_par *par;
+    int part;
+    bool queued;
+};
+
+static void ntt_part_run(struct work_struct *work)
+{
+    struct ntt_part *pt = container_of(work, struct ntt_part, work);
+    pt->par->phase(pt->par, pt->part);
+}
+
+/* [lo, hi) of @n items taken by @part */
+static inline void ntt_part_range(const struct ntt_par *par,
+                                  int part,
+                                  size_t n,
+                                  size_t *lo,
+                                  size_t *hi)
+{
+    *lo = n * part / par->nr;
+    *hi = n * (part + 1) / par->nr;
+}
+
+/* Run every part of @phase and wait for them */
+static void ntt_par_run(struct ntt_par *par,
+                        void (*phase)(struct ntt_par *, int))
+{
+    struct ntt_part pt[FBN_MUL_MAX_WORKERS];
+
+    par->phase = phase;
+    for (int i = 1; i < par->nr; ++i) {
+        pt[i].par = par;
+        pt[i].part = i;
+        INIT_WORK_ONSTACK(&pt[i].work, ntt_part_run);
+        pt[i].queued = fbn_queue_work(&pt[i].work);
+    }
+    phase(par, 0);
+    for (int i = 1; i < par->nr; ++i) {
+        if (pt[i].queued)
+            fbn_flush_work(&pt[i].work);
+        else
+            phase(par, i);
+        destroy_work_on_stack(&pt[i].work);
+    }
+}
+
+/* The twiddles and the operands, cut by the index */
+static void ntt_par_load(struct ntt_par *par, int part)
+{
+    size_t len = (size_t) 1 << par->logn, lo, hi;
+
+    ntt_part_range(par, part, len >> 1, &lo, &hi);
+    ntt_twiddles_range(par->m, par->tw, par->w, lo, hi);
+    ntt_part_range(par, part, len, &lo, &hi);
+    ntt_load_range(par->m, par->x, par->a, par->an, lo, hi);
+    if (par->y)
+        ntt_load_range(par->m, par->y, par->b, par->bn, lo, hi);
+}
+
+/* A forward stage across the blocks, cut by the butterflies */
+static void ntt_par_top_fwd(struct ntt_par *par, int part)
+{
+    size_t len = (size_t) 1 << par->logn, lo, hi;
+
+    ntt_part_range(par, part, par->h, &lo, &hi);
+    ntt_forward_stage(par->m, par->x, par->tw, par->logn, par->h, 0, len, lo,
+                      hi);
+    if (par->y)
+        ntt_forward_stage(par->m, par->y, par->tw, par->logn, par->h, 0, len,
+                          lo, hi);
+}
+
+/*
+ * The forward stages within a block, the pointwise product and the inverse
+ * stages within a block, cut by the blocks
+ */
+static void ntt_par_blocks(struct ntt_par *par, int part)
+{
+    const struct ntt_mont *m = par->m;
+    size_t bs = par->bs, lo, hi;
+    u64 *x = par->x, *y = par->y ? par->y : par->x;
+
+    ntt_part_range(par, part, ((size_t) 1 << par->logn) / bs, &lo, &hi);
+    lo *= bs;
+    hi *= bs;
+    for (size_t h = bs >> 1; h; h >>= 1) {
+        ntt_forward_stage(m, x, par->tw, par->logn, h, lo, hi, 0, h);
+        if (par->y)
+            ntt_forward_stage(m, y, par->tw, par->logn, h, lo, hi, 0, h);
+    }
+    for (size_t i = lo; i < hi; ++i)
+        x[i] = mont_mul(m, mont_mul(m, x[i], y[i]), par->inv_len);
+    for (size_t h = 1; h < bs; h <<= 1)
+        ntt_inverse_stage(m, x, par->tw, par->logn, h, lo, hi, 0, h);
+}
+
+/* An inverse stage across the blocks, cut by the butterflies */
+static void ntt_par_top_inv(struct ntt_par *par, int part)
+{
+    size_t len = (size_t) 1 << par->logn, lo, hi;
+
+    ntt_part_range(par, part, par->h, &lo, &hi);
+    ntt_inverse_stage(par->m, par->x, par->tw, par->logn, par->h, 0, len, lo,
+                      hi);
+}
+
+/* The CRT, cut into bands of coefficients */
+static void ntt_par_crt(struct ntt_par *par, int part)
+{
+    size_t lo, hi;
+
+    ntt_part_range(par, part, par->rn, &lo, &hi);
+    ntt_crt(par->r, lo, hi, par->res, par->carry[part]);
+}
+
+/*
+ * r = a * b (a^2 if par->y is NULL) on par->nr CPUs, the scratch is laid
+ * out like the serial one. Each transform runs its stages longer than a
+ * block cut by the butterflies, and the rest block by block, so a part never
+ * waits for another within a phase.
+ */
+static void ntt_mul_par(struct ntt_par *par, u64 *scratch)
+{
+    size_t len = (size_t) 1 << par->logn;
+    u64 *res[NTT_NPRIMES], carry[FBN_MUL_MAX_WORKERS][3];
+    /* a few blocks per part even out the parts */
+    int logb = ntt_log(4 * par->nr);
+
+    if (logb > par->logn - 1)
+        logb = par->logn - 1;
+    par->bs = len >> logb;
+    for (int k = 0; k < NTT_NPRIMES; ++k) {
+        struct ntt_mont m;
+        ntt_mont_init(&m, ntt_primes[k]);
+        par->m = &m;
+        par->x = res[k] = scratch + k * len;
+        par->w = ntt_root(&m, par->logn);
+        /* scale by 1/len (and R for the Montgomery product) in advance */
+        par->inv_len =
+            mont_from(&m, mont_from(&m, m.p - ((m.p - 1) >> par->logn)));
+
+        ntt_par_run(par, ntt_par_load);
+        for (par->h = len >> 1; par->h >= par->bs; par->h >>= 1)
+            ntt_par_run(par, ntt_par_top_fwd);
+        ntt_par_run(par, ntt_par_blocks);
+        for (par->h = par->bs; par->h < len; par->h <<= 1)
+            ntt_par_run(par, ntt_par_top_inv);
+    }
+
+    par->res = res;
+    par->carry = carry;
+    ntt_par_run(par, ntt_par_crt);
+    /* the carry out of every band goes into the next ones */
+    for (int i = 0; i + 1 < par->nr; ++i)
+        ntt_add_carry(par->r, (size_t) par->rn * (i + 1) / par->nr, par->rn,
+                      carry[i]);
+}
+
+/* Parts of a product with the shorter operand of @n limbs, 1 for serial */
+static int ntt_parts(int n)
+{
+    int nr = READ_ONCE(fbn_mul_workers), cpus = num_online_cpus();
+
+    if (nr <= 1 || n < READ_ONCE(fbn_mul_grain))
+        return 1;
+    if (nr > cpus)
+        nr = cpus;
+    return nr < FBN_MUL_MAX_WORKERS ? nr : FBN_MUL_MAX_WORKERS;
+}
+
+/*
+ * r = a * b, r has (an + bn) limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least fbn_ntt_scratch(an, bn)
+ */
+void fbn_ntt_mul(fbn_limb *r,
+                 const fbn_limb *a,
+                 int an,
+                 const fbn_limb *b,
+                 int bn,
+                 fbn_limb *scratch)
+{
+    int logn = ntt_log(an + bn), nr = ntt_parts(an < bn ? an : bn);
+    size_t len = (size_t) 1 << logn;
+    u64 *res[NTT_NPRIMES], *y = (u64 *) scratch + NTT_NPRIMES * len;
+    u64 *tw = y + len, carry[3];
+
+    if (nr > 1) {
+        struct ntt_par par = {.nr = nr, .y = y, .tw = tw, .logn = logn,
+                              .a = a, .b = b, .an = an, .bn = bn,
+                              .r = r, .rn = an + bn};
+        ntt_mul_par(&par, (u64 *) scratch);
+        return;
+    }
+    for (int k = 0; k < NTT_NPRIMES; ++k) {
+        struct ntt_mont m;
+        ntt_mont_init(&m, ntt_primes[k]);
+        u64 *x = res[k] = (u64 *) scratch + k * len;
+        /* scale by 1/len (and R for the Montgomery product) in advance */
+        u64 inv_len = mont_from(&m, mont_from(&m, m.p - ((m.p - 1) >> logn)));
+
+        ntt_twiddles(&m, tw, logn);
+        ntt_load(&m, x, a, an, logn);
+        ntt_load(&m, y, b, bn, logn);
+        ntt_forward(&m, x, tw, logn);
+        ntt_forward(&m, y, tw, logn);
+        for (size_t i = 0; i < len; ++i)
+            x[i] = mont_mul(&m, mont_mul(&m, x[i], y[i]), inv_len);
+        ntt_inverse(&m, x, tw, logn);
+    }
+    ntt_crt(r, 0, an + bn, res, carry);
+}
+
+/*
+ * r = a^2, r has 2n limbs.
+ * @r cannot overlap @a or @scratch.
+ * @scratch: temporary limbs, at least fbn_ntt_scratch(n, 0)
+ */
+void fbn_ntt_sqr(fbn_limb *r, const fbn_limb *a, int n, fbn_limb *scratch)
+{
+    int logn = ntt_log(2 * n), nr = ntt_parts(n);
+    size_t len = (size_t) 1 << logn;
+    u64 *res[NTT_NPRIMES], *tw = (u64 *) scratch + NTT_NPRIMES * len;
+    u64 carry[3];
+
+    if (nr > 1) {
+        struct ntt_par par = {.nr = nr, .tw = tw, .logn = logn, .a = a,
+                              .an = n, .r = r, .rn = 2 * n};
+        ntt_mul_par(&par, (u64 *) scratch);
+        return;
+    }
+    for (int k = 0; k < NTT_NPRIMES; ++k) {
+        struct ntt_mont m;
+        ntt_mont_init(&m, ntt_primes[k]);
+        u64 *x = res[k] = (u64 *) scratch + k * len;
+        u64 inv_len = mont_from(&m, mont_from(&m, m.p - ((m.p - 1) >> logn)));
+
+        ntt_twiddles(&m, tw, logn);
+        ntt_load(&m, x, a, n, logn);
+        ntt_forward(&m, x, tw, logn);
+        for (size_t i = 0; i < len; ++i)
+            x[i] = mont_mul(&m, mont_mul(&m, x[i], x[i]), inv_len);
+        ntt_inverse(&m, x, tw, logn);
+    }
+    ntt_crt(r, 0, 2 * n, res, carry);
+}
+
+#endif /* FBN_HAVE_NTT */
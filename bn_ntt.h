@@ -0,0 +1,40 @@
+#ifndef __FBN_NTT_H_
+#define __FBN_NTT_H_
+
+#include "bn_fib.h"
+
+#ifdef FBN_HAVE_NTT
+/*
+ * Number-theoretic transform multiplication.
+ *
+ * Every limb is a coefficient, the convolution is computed modulo three
+ * 63-bit primes p = c * 2^46 + 1 with Montgomery arithmetic (integer only, no
+ * FPU state needed) and recovered by CRT, so a product of up to 2^46 limbs is
+ * exact.
+ */
+
+/*
+ * Scratch limbs needed by fbn_ntt_mul() or fbn_ntt_sqr().
+ * @an, @bn: the operand lengths, @bn = 0 for squaring
+ */
+size_t fbn_ntt_scratch(int an, int bn);
+/*
+ * r = a * b, r has (an + bn) limbs.
+ * @r cannot overlap @a, @b or @scratch.
+ * @scratch: temporary limbs, at least fbn_ntt_scratch(an, bn)
+ */
+void fbn_ntt_mul(fbn_limb *r,
+                 const fbn_limb *a,
+                 int an,
+                 const fbn_limb *b,
+                 int bn,
+                 fbn_limb *scratch);
+/*
+ * r = a^2, r has 2n limbs.
+ * @r cannot overlap @a or @scratch.
+ * @scratch: temporary limbs, at least fbn_ntt_scratch(n, 0)
+ */
+void fbn_ntt_sqr(fbn_limb *r, const fbn_limb *a, int n, fbn_limb *scratch);
+#endif /* FBN_HAVE_NTT */
+
+#endif /* __FBN_NTT_H_ */
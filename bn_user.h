@@ -0,0 +1,127 @@
+#ifndef __FBN_USER_H_
+#define __FBN_USER_H_
+
+/*
+ * Minimal kernel API used by the fbn library, mapped onto libc, so that
+ * bn_fib.c and bn_ntt.c can be built and tested in user space.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+#if defined(__x86_64__) || defined(__LP64__)
+#define CONFIG_64BIT
+#endif
+
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *) &(x))
+#define WRITE_ONCE(x, v) (*(volatile __typeof__(x) *) &(x) = (v))
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define GFP_KERNEL 0
+#define kmalloc(size, flags) malloc(size)
+#define kcalloc(n, size, flags) calloc(n, size)
+#define kmalloc_array(n, size, flags) malloc((n) * (size))
+#define kfree(p) free(p)
+#define kvmalloc(size, flags) malloc(size)
+#define kvmalloc_array(n, size, flags) malloc((n) * (size))
+#define kvcalloc(n, size, flags) calloc(n, size)
+#define kvfree(p) free(p)
+
+#define pr_info(...) printf(__VA_ARGS__)
+
+#define DEFINE_MUTEX(m) pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_trylock(m) (!pthread_mutex_trylock(m))
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+
+/* no preemption nor signals to care about in user space */
+#define cond_resched() ((void) 0)
+#define current NULL
+#define fatal_signal_pending(p) 0
+
+#ifndef num_online_cpus
+#define num_online_cpus() ((int) sysconf(_SC_NPROCESSORS_ONLN))
+#endif
+
+typedef struct {
+    int counter;
+} atomic_t;
+#define ATOMIC_INIT(i) {(i)}
+#define atomic_inc_return(v) \
+    __atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec(v) \
+    ((void) __atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST))
+
+/* A work item is run by a thread of its own, flush_work() joins it */
+struct work_struct {
+    pthread_t thread;
+    void (*func)(struct work_struct *);
+    bool inline_run;
+};
+/* Any workqueue is a thread per work item, max_active is not enforced */
+struct workqueue_struct {
+    int max_active;
+};
+#define WQ_UNBOUND 0
+static inline struct workqueue_struct *alloc_workqueue(const char *name,
+                                                       unsigned int flags,
+                                                       int max_active)
+{
+    struct workqueue_struct *wq = malloc(sizeof(*wq));
+    if (wq)
+        wq->max_active = max_active;
+    return wq;
+}
+#define destroy_workqueue(wq) free(wq)
+#define INIT_WORK_ONSTACK(w, f) ((w)->func = (f))
+#define destroy_work_on_stack(w) ((void) (w))
+
+static inline void *__work_thread(void *w)
+{
+    ((struct work_struct *) w)->func(w);
+    return NULL;
+}
+
+static inline bool queue_work(struct workqueue_struct *wq,
+                              struct work_struct *w)
+{
+    w->inline_run = pthread_create(&w->thread, NULL, __work_thread, w);
+    if (w->inline_run)
+        w->func(w); /* no thread, run it here */
+    return true;
+}
+
+static inline bool flush_work(struct work_struct *w)
+{
+    if (!w->inline_run)
+        pthread_join(w->thread, NULL);
+    return true;
+}
+
+static inline int fls(unsigned int x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline int fls64(u64 x)
+{
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+#endif /* __FBN_USER_H_ */
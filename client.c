@@ -1,10 +1,14 @@
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "fibdrv.h"
+
 #define FIB_DEV "/dev/fibonacci"
 
 enum {
@@ -14,6 +18,47 @@ enum {
 };
 #define METHOD BNFIB_FASTDBLv1
 
+/* Jobs of the asynchronous mode, each on its own open file */
+#define NJOB 4
+#define ASYNC_N 1000000
+
+/* One thread drives NJOB computations by poll() and nonblocking reads */
+static void async_demo(void)
+{
+    struct pollfd pfd[NJOB];
+    size_t size = 256 * 1024;
+    char *buf = malloc(size);
+    int left = 0;
+
+    for (int i = 0; i < NJOB && buf; ++i) {
+        __u64 n = ASYNC_N + i;
+        pfd[i].fd = open(FIB_DEV, O_RDONLY | O_NONBLOCK);
+        pfd[i].events = POLLIN;
+        if (pfd[i].fd < 0 || ioctl(pfd[i].fd, FIB_IOC_SUBMIT, &n)) {
+            perror("FIB_IOC_SUBMIT");
+            if (pfd[i].fd >= 0)
+                close(pfd[i].fd);
+            pfd[i].fd = -1;
+            continue;
+        }
+        ++left;
+    }
+    while (left > 0 && poll(pfd, NJOB, -1) > 0) {
+        for (int i = 0; i < NJOB; ++i) {
+            if (pfd[i].fd < 0 || !(pfd[i].revents & POLLIN))
+                continue;
+            ssize_t len = read(pfd[i].fd, buf, size);
+            if (len < 0)
+                continue; /* EAGAIN, not ready after all */
+            printf("F(%d) has %zd digits\n", ASYNC_N + i, len - 1);
+            close(pfd[i].fd);
+            pfd[i].fd = -1; /* poll() skips it */
+            --left;
+        }
+    }
+    free(buf);
+}
+
 int main()
 {
     char buf[1000] = {
@@ -27,15 +72,18 @@ int main()
         exit(1);
     }
 
+    /* sequential mode: every read returns F(f_pos) and moves to the next */
+    ioctl(fd, FIB_IOC_SET_SEQ, 1);
+    lseek(fd, 0, SEEK_SET);
     for (int i = 0; i <= offset; i++) {
-        lseek(fd, i, SEEK_SET);
-        read(fd, buf, METHOD);
+        read(fd, buf, sizeof(buf) - 1);
         printf("Reading from " FIB_DEV
                " at offset %d, returned the sequence "
                "%s.\n",
                i, buf);
     }
 
+    ioctl(fd, FIB_IOC_SET_SEQ, 0);
     for (int i = offset; i >= 0; i--) {
         lseek(fd, i, SEEK_SET);
         read(fd, buf, METHOD);
@@ -46,5 +94,7 @@ int main()
     }
 
     close(fd);
+
+    async_demo();
     return 0;
 }
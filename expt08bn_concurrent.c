@@ -0,0 +1,93 @@
+/*
+ * Load generator for concurrent clients: T threads, each with its own open
+ * file of the device, read F(NFIB) repeatedly for DURATION seconds. Print
+ * the total reads per second and the speedup over one thread for
+ * T = 1 .. argv[1] (default: online CPUs). Load the module with cache_size=0,
+ * otherwise the reads are served by the result cache.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fibdrv.h"
+
+#define FIB_DEV "/dev/fibonacci"
+#define NFIB 10000 /* Be ware of the buf size */
+#define DURATION 2 /* seconds per thread count */
+
+struct worker {
+    pthread_t tid;
+    long long nread;
+    int fail;
+};
+
+static atomic_int stop;
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+    char buf[2200];
+
+    int fd = open(FIB_DEV, O_RDWR);
+    if (fd < 0) {
+        w->fail = 1;
+        return NULL;
+    }
+    lseek(fd, NFIB, SEEK_SET);
+    /* the decimal read() does not advance f_pos, every read computes */
+    while (!atomic_load(&stop)) {
+        if (read(fd, buf, FIB_ENG_FASTDBLv1) < 0) {
+            w->fail = 1;
+            break;
+        }
+        ++w->nread;
+    }
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int max = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+
+    if (max < 1)
+        max = 1;
+    struct worker *w = calloc(max, sizeof(*w));
+    if (!w)
+        exit(1);
+
+    printf("# %6s %12s %8s\n", "thread", "reads/s", "speedup");
+    for (int t = 1; t <= max; ++t) {
+        long long total = 0;
+        int fail = 0;
+
+        atomic_store(&stop, 0);
+        for (int i = 0; i < t; ++i) {
+            w[i].nread = 0;
+            w[i].fail = 0;
+            pthread_create(&w[i].tid, NULL, work, &w[i]);
+        }
+        sleep(DURATION);
+        atomic_store(&stop, 1);
+        for (int i = 0; i < t; ++i) {
+            pthread_join(w[i].tid, NULL);
+            total += w[i].nread;
+            fail |= w[i].fail;
+        }
+        if (fail) {
+            perror("Failed to read character device");
+            exit(1);
+        }
+
+        double rate = (double) total / DURATION;
+        if (t == 1)
+            base = rate;
+        printf("%8d %12.1f %8.2f\n", t, rate, base ? rate / base : 0);
+    }
+    free(w);
+    return 0;
+}
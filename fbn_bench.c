@@ -0,0 +1,270 @@
+/*
+ * This program benchmarks the fbn library in user space.
+ *
+ * The binary fast doubling engine plus the decimal conversion of
+ * fbn_printv1() is compared with the decimal-native engine, whose result is
+ * printed limb by limb. Every time is the best of NREPEAT runs in ns.
+ *
+ * Nearby indices are timed from scratch and resumed from the fast doubling
+ * checkpoints.
+ *
+ * One large product is timed on 1 .. 2 * online CPUs.
+ *
+ * Then T threads compute and print F(NTHREAD_FIB) in their own arenas like
+ * the readers of the driver, the throughput shows how the callers scale.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bn_fib.h"
+
+#define NREPEAT 5
+
+static long long elapsed(const struct timespec *t1, const struct timespec *t2)
+{
+    return (t2->tv_sec - t1->tv_sec) * 1000000000LL +
+           (t2->tv_nsec - t1->tv_nsec);
+}
+
+/*
+ * Time the engine and the printing of F(n), keep the best of NREPEAT.
+ * @str: the last printed string, freed by the caller
+ */
+static int bench_one(int (*fib)(fbn *, u64, struct fbn_progress *),
+                     char *(*print)(const fbn *),
+                     int n,
+                     long long *t_fib,
+                     long long *t_print,
+                     char **str)
+{
+    *t_fib = *t_print = -1;
+    *str = NULL;
+    for (int r = 0; r < NREPEAT; ++r) {
+        struct timespec t1, t2, t3;
+        fbn *f = fbn_alloc(1);
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        int rc = fib(f, n, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        char *s = rc ? NULL : print(f);
+        clock_gettime(CLOCK_MONOTONIC, &t3);
+        fbn_free(f);
+        if (!s)
+            return -1;
+
+        if (*t_fib < 0 || elapsed(&t1, &t2) < *t_fib)
+            *t_fib = elapsed(&t1, &t2);
+        if (*t_print < 0 || elapsed(&t2, &t3) < *t_print)
+            *t_print = elapsed(&t2, &t3);
+        free(*str);
+        *str = s;
+    }
+    return 0;
+}
+
+/* Binary engine + conversion vs decimal-native engine, n = 1k..1M */
+static int bench_dec(void)
+{
+    const int steps[] = {1, 2, 5};
+    int fail = 0;
+
+    printf("# %8s %12s %12s %12s %12s %12s %12s\n", "n", "bin_fib",
+           "bin_print", "bin_total", "dec_fib", "dec_print", "dec_total");
+    for (int scale = 1000; scale <= 1000000 && !fail; scale *= 10) {
+        for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+            int n = scale * steps[i];
+            long long bin_fib, bin_print, dec_fib, dec_print;
+            char *bin_str, *dec_str;
+
+            if (n > 1000000)
+                break;
+            fail |= bench_one(fbn_fib_fastdoublingv1, fbn_printv1, n,
+                              &bin_fib, &bin_print, &bin_str);
+            fail |= bench_one(fbn_fib_fastdoubling_dec, fbn_print_dec, n,
+                              &dec_fib, &dec_print, &dec_str);
+            if (!fail && strcmp(bin_str, dec_str)) {
+                printf("F(%d) mismatch\n", n);
+                fail = 1;
+            }
+            free(bin_str);
+            free(dec_str);
+            printf("%10d %12lld %12lld %12lld %12lld %12lld %12lld\n", n,
+                   bin_fib, bin_print, bin_fib + bin_print, dec_fib,
+                   dec_print, dec_fib + dec_print);
+        }
+    }
+    return fail;
+}
+
+/*
+ * Time of NCKPT indices near n, computed from scratch and then resumed from
+ * the checkpoints of the indices before them.
+ */
+#define NCKPT 64
+
+static long long bench_ckpt_run(int n, unsigned long size)
+{
+    struct timespec t1, t2;
+    fbn *f = fbn_alloc(1);
+
+    fbn_ckpt_size = size;
+    srand(n);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int i = 0; i < NCKPT; ++i)
+        fbn_fib_fastdoublingv1(f, n + rand() % 1024, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    fbn_free(f);
+    fbn_ckpt_free();
+    fbn_ckpt_size = FBN_CKPT_SIZE;
+    return elapsed(&t1, &t2) / NCKPT;
+}
+
+static int bench_ckpt(void)
+{
+    printf("# %8s %12s %12s\n", "n", "scratch", "checkpoint");
+    for (int n = 10000; n <= 1000000; n *= 10) {
+        printf("%10d %12lld %12lld\n", n, bench_ckpt_run(n, 0),
+               bench_ckpt_run(n, 64UL << 20));
+    }
+    return 0;
+}
+
+/* Latency of one F(n) with serial and parallel doubling steps */
+static long long bench_par_run(int n, int threshold)
+{
+    struct timespec t1, t2;
+    fbn *f = fbn_alloc(1);
+
+    fbn_par_threshold = threshold;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fbn_fib_fastdoublingv1(f, n, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    fbn_free(f);
+    fbn_par_threshold = FBN_PAR_THRESHOLD;
+    return elapsed(&t1, &t2);
+}
+
+static int bench_par(void)
+{
+    printf("# %d CPUs online\n", num_online_cpus());
+    printf("# %8s %12s %12s %8s\n", "n", "serial", "parallel", "speedup");
+    for (int n = 100000; n <= 10000000; n *= 10) {
+        long long serial = bench_par_run(n, 1 << 30);
+        long long par = bench_par_run(n, FBN_PAR_THRESHOLD);
+        printf("%10d %12lld %12lld %8.2f\n", n, serial, par,
+               (double) serial / par);
+    }
+    return 0;
+}
+
+#ifdef FBN_HAVE_NTT
+/* One NTT product of NMUL_LEN limbs on W = 1 .. 2 * online CPUs */
+#define NMUL_LEN (1 << 17)
+
+static int bench_mul(void)
+{
+    fbn *a = fbn_alloc(1), *b = fbn_alloc(1), *c = fbn_alloc(1);
+    int max = 2 * num_online_cpus();
+    long long base = 0;
+
+    /* a = 2^k - 1, b = 2^k - 2, the time does not depend on the limbs */
+    fbn_set_u32(c, 1);
+    fbn_set_u32(a, 1);
+    fbn_lshift(a, NMUL_LEN * FBN_LIMB_BITS);
+    fbn_sub(a, a, c);
+    fbn_sub(b, a, c);
+    printf("# %6s %12s %8s\n", "worker", "mul", "speedup");
+    for (int w = 1; w <= max && w <= FBN_MUL_MAX_WORKERS; w *= 2) {
+        long long best = -1;
+
+        fbn_mul_workers = w;
+        for (int r = 0; r < NREPEAT; ++r) {
+            struct timespec t1, t2;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            fbn_mul(c, a, b);
+            clock_gettime(CLOCK_MONOTONIC, &t2);
+            if (best < 0 || elapsed(&t1, &t2) < best)
+                best = elapsed(&t1, &t2);
+        }
+        if (w == 1)
+            base = best;
+        printf("%8d %12lld %8.2f\n", w, best, (double) base / best);
+    }
+    fbn_mul_workers = FBN_MUL_WORKERS;
+    fbn_free(a);
+    fbn_free(b);
+    fbn_free(c);
+    return 0;
+}
+#else
+static int bench_mul(void)
+{
+    return 0;
+}
+#endif
+
+#define NTHREAD_FIB 100000
+#define NTHREAD_ITER 20
+
+static void *thread_fib(void *arg)
+{
+    long fail = 0;
+
+    for (int i = 0; i < NTHREAD_ITER && !fail; ++i) {
+        struct fbn_arena arena;
+        if (fbn_arena_init(&arena, fbn_arena_size_fib(NTHREAD_FIB)))
+            return (void *) 1L;
+        fbn *f = fbn_alloc_fib(&arena, NTHREAD_FIB);
+        fbn_fib_fastdoublingv1(f, NTHREAD_FIB, NULL);
+        fail = !fbn_printv1_arena(f, &arena);
+        fbn_arena_destroy(&arena);
+    }
+    return (void *) fail;
+}
+
+/* Throughput of T concurrent callers, T = 1 .. 2 * online CPUs */
+static int bench_threads(void)
+{
+    int max = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *tid = malloc(max * sizeof(*tid));
+    double base = 0;
+    int fail = !tid;
+
+    printf("# %6s %12s %8s\n", "thread", "F(n)/s", "speedup");
+    for (int t = 1; t <= max && !fail; t *= 2) {
+        struct timespec t1, t2;
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        for (int i = 0; i < t; ++i)
+            pthread_create(&tid[i], NULL, thread_fib, NULL);
+        for (int i = 0; i < t; ++i) {
+            void *ret;
+            pthread_join(tid[i], &ret);
+            fail |= ret != NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        double rate = t * NTHREAD_ITER * 1e9 / elapsed(&t1, &t2);
+        if (t == 1)
+            base = rate;
+        printf("%8d %12.1f %8.2f\n", t, rate, rate / base);
+    }
+    free(tid);
+    return fail;
+}
+
+int main(void)
+{
+    if (fbn_wq_init())
+        return 1;
+    int fail = bench_dec() | bench_ckpt() | bench_par() | bench_mul() |
+               bench_threads();
+    fbn_wq_destroy();
+    fbn_scratch_free();
+    fbn_dec_pow_free();
+    return fail;
+}
@@ -0,0 +1,633 @@
+/*
+ * This program tests the fbn library in user space.
+ *
+ * Every multiplication tier (Karatsuba, Toom-3 and NTT) is compared with the
+ * long multiplication on random operands, the divide-and-conquer decimal
+ * conversion is compared with the short division, and F(n) computed by
+ * different engines are compared with each other.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bn_fib.h"
+
+#define NROUND 200
+#define MAXLEN 3000
+
+static void fbn_random(fbn *obj, int len)
+{
+    fbn *tmp = fbn_alloc(len);
+    for (int i = 0; i < len; ++i) {
+        u64 r = (u64) rand() << 42 ^ (u64) rand() << 21 ^ rand();
+        /* all-ones limbs stress the carries */
+        tmp->num[i] = rand() % 8 ? (fbn_limb) r : (fbn_limb) -1;
+    }
+    tmp->num[len - 1] |= 1;
+    tmp->len = len;
+    fbn_copy(obj, tmp);
+    fbn_free(tmp);
+}
+
+static int fbn_equal(const fbn *a, const fbn *b)
+{
+    return a->len == b->len &&
+           !memcmp(a->num, b->num, sizeof(fbn_limb) * a->len);
+}
+
+/* Set the limb thresholds of every tier, a huge threshold disables it */
+static void set_thresholds(int kara, int toom3, int ntt)
+{
+    fbn_karatsuba_threshold = fbn_karatsuba_sqr_threshold = kara;
+    fbn_toom3_threshold = fbn_toom3_sqr_threshold = toom3;
+#ifdef FBN_HAVE_NTT
+    fbn_ntt_threshold = ntt;
+#endif
+}
+
+static int test_mul(void)
+{
+    const int tiers[][3] = {
+        {4, 1 << 30, 1 << 30}, /* Karatsuba */
+        {4, 16, 1 << 30},      /* Toom-3 */
+        {4, 16, 1},            /* NTT */
+        {FBN_KARATSUBA_THRESHOLD, FBN_TOOM3_THRESHOLD, 256},
+    };
+    fbn *a = fbn_alloc(1), *b = fbn_alloc(1);
+    fbn *c = fbn_alloc(1), *expect = fbn_alloc(1);
+    int fail = 0;
+    int kara = fbn_karatsuba_threshold, kara_sqr = fbn_karatsuba_sqr_threshold;
+    int toom3 = fbn_toom3_threshold, toom3_sqr = fbn_toom3_sqr_threshold;
+#ifdef FBN_HAVE_NTT
+    int ntt = fbn_ntt_threshold;
+#endif
+
+    for (int i = 0; i < NROUND && !fail; ++i) {
+        int an = rand() % MAXLEN + 1, sqr = rand() % 2;
+        int bn = rand() % 2 ? an - rand() % 3 : rand() % MAXLEN + 1;
+        fbn_random(a, an);
+        fbn_random(b, bn > 0 ? bn : 1);
+
+        set_thresholds(1 << 30, 1 << 30, 1 << 30);
+        if (sqr)
+            fbn_mul(expect, a, a);
+        else
+            fbn_mul(expect, a, b);
+        for (size_t t = 0; t < sizeof(tiers) / sizeof(tiers[0]); ++t) {
+            set_thresholds(tiers[t][0], tiers[t][1], tiers[t][2]);
+            if (sqr)
+                fbn_sqr(c, a);
+            else
+                fbn_mul(c, a, b);
+            if (!fbn_equal(c, expect)) {
+                printf("%s mismatch: tier %zu, len %d x %d\n",
+                       sqr ? "fbn_sqr" : "fbn_mul", t, a->len, b->len);
+                fail = 1;
+            }
+        }
+    }
+    fbn_karatsuba_threshold = kara, fbn_karatsuba_sqr_threshold = kara_sqr;
+    fbn_toom3_threshold = toom3, fbn_toom3_sqr_threshold = toom3_sqr;
+#ifdef FBN_HAVE_NTT
+    fbn_ntt_threshold = ntt;
+#endif
+
+    fbn_free(a);
+    fbn_free(b);
+    fbn_free(c);
+    fbn_free(expect);
+    return fail;
+}
+
+/*
+ * Print by the short division, by divide-and-conquer and by divide-and-conquer
+ * with the halves on workers, then compare
+ */
+static int print_equal(const fbn *obj)
+{
+    int dc = fbn_dec_dc_threshold;
+    fbn_dec_dc_threshold = 1 << 30;
+    char *expect = fbn_printv1(obj);
+    fbn_dec_dc_threshold = 1;
+    fbn_dec_par_threshold = 1 << 30;
+    char *str = fbn_printv1(obj);
+    fbn_dec_par_threshold = 1;
+    char *par = fbn_printv1(obj);
+    fbn_dec_par_threshold = FBN_DEC_PAR_THRESHOLD;
+    fbn_dec_dc_threshold = dc;
+
+    int equal = expect && str && par && !strcmp(expect, str) &&
+                !strcmp(expect, par);
+    free(expect);
+    free(str);
+    free(par);
+    return equal;
+}
+
+static int test_print(void)
+{
+    fbn *a = fbn_alloc(1), *ten = fbn_alloc(1), *one = fbn_alloc(1);
+    int fail = 0;
+
+    for (int i = 0; i < NROUND && !fail; ++i) {
+        fbn_random(a, rand() % MAXLEN + 1);
+        if (!print_equal(a)) {
+            printf("fbn_printv1 mismatch: len %d\n", a->len);
+            fail = 1;
+        }
+    }
+
+    /* 10^k and 10^k - 1 cross every boundary of the decimal pieces */
+    fbn_set_u32(a, 1);
+    fbn_set_u32(ten, 10);
+    fbn_set_u32(one, 1);
+    for (int k = 1; k <= 2000 && !fail; ++k) {
+        fbn_mul(a, a, ten);
+        fbn_sub(a, a, one);
+        fail = !print_equal(a);
+        fbn_add(a, a, one);
+        fail |= !print_equal(a);
+        if (fail)
+            printf("fbn_printv1 mismatch: 10^%d\n", k);
+    }
+
+    fbn_free(a);
+    fbn_free(ten);
+    fbn_free(one);
+    return fail;
+}
+
+/* Rebuild the limbs from the raw bytes and from the hex digits */
+static int test_raw(void)
+{
+    fbn *a = fbn_alloc(1);
+    int fail = 0;
+
+    for (int i = 0; i < NROUND && !fail; ++i) {
+        if (!i)
+            fbn_set_u32(a, 0);
+        else
+            fbn_random(a, rand() % MAXLEN + 1);
+        if (i % 4 == 1)
+            a->num[a->len - 1] &= 0xff; /* short top limb */
+        size_t raw_size = fbn_raw_size(a), hex_size = fbn_hex_size(a);
+        u8 *raw = malloc(raw_size);
+        char *hex = malloc(hex_size);
+        fbn_to_raw(a, raw);
+        fbn_to_hex(a, hex);
+
+        fail = raw_size > 1 && !raw[raw_size - 1];
+        fail |= strlen(hex) != hex_size - 1 || (hex_size > 2 && hex[0] == '0');
+        for (int j = 0; j < a->len && !fail; ++j) {
+            fbn_limb limb = 0;
+            for (size_t k = 0; k < sizeof(fbn_limb); ++k) {
+                size_t b = j * sizeof(fbn_limb) + k;
+                limb |= (fbn_limb) (b < raw_size ? raw[b] : 0) << (8 * k);
+            }
+            fail = limb != a->num[j];
+        }
+        fbn_limb limb = 0;
+        for (size_t j = 0; j < hex_size - 1 && !fail; ++j) {
+            size_t d = hex_size - 2 - j; /* nibble index from the lowest */
+            int v = hex[j] <= '9' ? hex[j] - '0' : hex[j] - 'a' + 10;
+            limb |= (fbn_limb) v << (4 * (d % (FBN_LIMB_BITS / 4)));
+            if (!(d % (FBN_LIMB_BITS / 4))) {
+                fail = limb != a->num[d / (FBN_LIMB_BITS / 4)];
+                limb = 0;
+            }
+        }
+        if (fail)
+            printf("fbn_to_raw/fbn_to_hex mismatch: len %d\n", a->len);
+        free(raw);
+        free(hex);
+    }
+
+    fbn_free(a);
+    return fail;
+}
+
+static int test_fib(void)
+{
+    const int nfib[] = {0, 1, 2, 3, 93, 94, 1000, 10000, 100000, 300000};
+    int fail = 0;
+
+    for (size_t i = 0; i < sizeof(nfib) / sizeof(nfib[0]); ++i) {
+        fbn *f0 = fbn_alloc(1), *f1 = fbn_alloc(1), *f2 = fbn_alloc(1);
+        fbn *f3 = fbn_alloc(1);
+        fbn_fib_defi(f0, nfib[i], NULL);
+        fbn_fib_fastdoubling(f1, nfib[i], NULL);
+        fbn_fib_fastdoublingv1(f2, nfib[i], NULL);
+        fbn_fib_fastdoubling_dec(f3, nfib[i], NULL);
+        if (!fbn_equal(f0, f1) || !fbn_equal(f0, f2)) {
+            printf("F(%d) mismatch\n", nfib[i]);
+            fail = 1;
+        }
+        char *expect = fbn_printv1(f0), *str = fbn_print_dec(f3);
+        if (strcmp(expect, str)) {
+            printf("F(%d) mismatch: decimal-native\n", nfib[i]);
+            fail = 1;
+        }
+        free(expect);
+        free(str);
+        /* F(n), F(n + 1) and F(n + 2) by additions */
+        fbn_fib_pair(f1, f3, nfib[i], NULL);
+        fbn_add(f3, f3, f1);
+        fbn_fib_fastdoublingv1(f2, nfib[i] + 2, NULL);
+        if (!fbn_equal(f0, f1) || !fbn_equal(f2, f3)) {
+            printf("F(%d) mismatch: fbn_fib_pair\n", nfib[i]);
+            fail = 1;
+        }
+        /* the engines allocate the final capacity once */
+        int cap = fbn_fib_cap(nfib[i]);
+        if (f0->cap > cap || f1->cap > cap || f2->cap > cap || f3->cap > cap) {
+            printf("F(%d) exceeds fbn_fib_cap()\n", nfib[i]);
+            fail = 1;
+        }
+        fbn_free(f0);
+        fbn_free(f1);
+        fbn_free(f2);
+        fbn_free(f3);
+    }
+    return fail;
+}
+
+/* Fast doubling resumed from checkpoints gives the same numbers */
+static int test_ckpt(void)
+{
+    /* indices sharing long binary prefixes, and the budget of a few pairs */
+    const int base[] = {4096, 65536, 100000, 262143};
+    const unsigned long budget[] = {1UL << 24, 40000};
+    fbn *expect = fbn_alloc(1), *f0 = fbn_alloc(1), *f1 = fbn_alloc(1);
+    fbn *f2 = fbn_alloc(1), *f3 = fbn_alloc(1);
+    int fail = 0;
+
+    for (size_t b = 0; b < sizeof(budget) / sizeof(budget[0]); ++b) {
+        for (size_t i = 0; i < sizeof(base) / sizeof(base[0]); ++i) {
+            for (int d = 0; d < 300 && !fail; d += 23) {
+                /* back and forth, so checkpoints are passed both ways */
+                int n = base[i] + ((d / 23) & 1 ? 300 - d : d);
+                fbn_ckpt_size = 0;
+                fbn_fib_fastdoublingv1(expect, n, NULL);
+                fbn_ckpt_size = budget[b];
+                fbn_fib_fastdoublingv1(f0, n, NULL);
+                fbn_fib_fastdoubling(f1, n, NULL);
+                fbn_fib_pair(f2, f3, n, NULL);
+                if (!fbn_equal(expect, f0) || !fbn_equal(expect, f1) ||
+                    !fbn_equal(expect, f2)) {
+                    printf("F(%d) mismatch: checkpoints of %lu bytes\n", n,
+                           budget[b]);
+                    fail = 1;
+                }
+            }
+        }
+        fbn_ckpt_free();
+    }
+
+    /*
+     * The top prefixes of n are kept on the way: asked to stop, a request
+     * for one of them still ends at its last bit, the next one does not
+     */
+    const u64 top = 1000003;
+    fbn_ckpt_size = 1UL << 24;
+    fbn_fib_fastdoublingv1(f0, top, NULL);
+    for (int s = 0; s <= 4; ++s) {
+        struct fbn_progress prog = {.abort = true};
+        int rc = fbn_fib_fastdoublingv1(f0, top >> s, &prog);
+        if (rc != -EINTR || (prog.done == prog.total) != (s < 4)) {
+            printf("prefix F(%llu) not kept as expected\n",
+                   (unsigned long long) (top >> s));
+            fail = 1;
+        }
+    }
+    fbn_ckpt_free();
+    fbn_ckpt_size = FBN_CKPT_SIZE;
+    fbn_free(expect);
+    fbn_free(f0);
+    fbn_free(f1);
+    fbn_free(f2);
+    fbn_free(f3);
+    return fail;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *) a, y = *(const u64 *) b;
+    return (x > y) - (x < y);
+}
+
+/* Sorted indices with duplicates, neighbours and far jumps */
+static int test_batch(void)
+{
+    enum { CNT = 300 };
+    u64 n[CNT];
+    int fail = 0;
+    fbn *res[CNT], *expect = fbn_alloc(1);
+    struct fbn_batch_stats st;
+
+    for (int i = 0; i < CNT; ++i) {
+        n[i] = i % 3 ? rand() % 50000 : (i ? n[i - 1] + rand() % 5 : 0);
+        res[i] = fbn_alloc(1);
+    }
+    qsort(n, CNT, sizeof(u64), cmp_u64);
+    fail = fbn_fib_batch(res, n, CNT, &st, NULL) ||
+           st.nrestart + st.nstep + st.njump != CNT || !st.njump ||
+           st.cost > st.cost_restart;
+    for (int i = 0; i < CNT && !fail; ++i) {
+        fbn_fib_fastdoublingv1(expect, n[i], NULL);
+        fail = !fbn_equal(expect, res[i]);
+    }
+    if (fail)
+        printf("fbn_fib_batch mismatch\n");
+
+    for (int i = 0; i < CNT; ++i)
+        fbn_free(res[i]);
+    fbn_free(expect);
+    return fail;
+}
+
+#ifdef FBN_HAVE_NTT
+/* NTT products cut across workers give the serial ones, down to 1 limb */
+static int test_mul_par(void)
+{
+    fbn *a = fbn_alloc(1), *b = fbn_alloc(1);
+    fbn *c = fbn_alloc(1), *expect = fbn_alloc(1);
+    int ntt = fbn_ntt_threshold, fail = 0;
+
+    fbn_ntt_threshold = 1;
+    fbn_mul_grain = 1;
+    for (int i = 0; i < NROUND && !fail; ++i) {
+        int an = rand() % MAXLEN + 1, bn = rand() % MAXLEN + 1;
+        int sqr = rand() % 2;
+        fbn_random(a, an);
+        fbn_random(b, bn);
+
+        fbn_mul_workers = 1;
+        if (sqr)
+            fbn_sqr(expect, a);
+        else
+            fbn_mul(expect, a, b);
+        fbn_mul_workers = 2 + i % 3;
+        if (sqr)
+            fbn_sqr(c, a);
+        else
+            fbn_mul(c, a, b);
+        if (!fbn_equal(c, expect)) {
+            printf("parallel %s mismatch: %d workers, len %d x %d\n",
+                   sqr ? "fbn_sqr" : "fbn_mul", fbn_mul_workers, an, bn);
+            fail = 1;
+        }
+    }
+    fbn_ntt_threshold = ntt;
+    fbn_mul_workers = FBN_MUL_WORKERS;
+    fbn_mul_grain = FBN_MUL_GRAIN;
+
+    fbn_free(a);
+    fbn_free(b);
+    fbn_free(c);
+    fbn_free(expect);
+    return fail;
+}
+#else
+static int test_mul_par(void)
+{
+    return 0;
+}
+#endif
+
+/*
+ * Doubling steps with the products on workers give the same numbers, and so
+ * do the parts run by the caller without the workqueue
+ */
+static int test_par(void)
+{
+    const int nfib[] = {5000, 65537, 200000};
+    fbn *expect = fbn_alloc(1), *f = fbn_alloc(1), *f1 = fbn_alloc(1);
+    int fail = 0;
+
+    for (size_t i = 0; i < sizeof(nfib) / sizeof(nfib[0]); ++i) {
+        fbn_par_threshold = 1 << 30;
+        fbn_fib_fastdoublingv1(expect, nfib[i], NULL);
+        fbn_par_threshold = 8;
+        fbn_fib_fastdoublingv1(f, nfib[i], NULL);
+        fail |= !fbn_equal(expect, f);
+        fbn_fib_pair(f, f1, nfib[i], NULL);
+        fail |= !fbn_equal(expect, f);
+        fbn_wq_destroy();
+        fbn_fib_fastdoublingv1(f, nfib[i], NULL);
+        fail |= !fbn_equal(expect, f) || fbn_wq_init();
+    }
+    if (fail)
+        printf("parallel fast doubling mismatch\n");
+    fbn_par_threshold = FBN_PAR_THRESHOLD;
+    fbn_free(expect);
+    fbn_free(f);
+    fbn_free(f1);
+    return fail;
+}
+
+/* Indices beyond FBN_FIB_MAX_N are refused instead of overflowing */
+static int test_limits(void)
+{
+    fbn *f = fbn_alloc(1), *g = fbn_alloc(1);
+    u64 big = FBN_FIB_MAX_N + 1;
+    int fail = fbn_fib_cap(FBN_FIB_MAX_N) > FBN_MAX_LIMBS ||
+               fbn_alloc(FBN_MAX_LIMBS + 1);
+
+    fbn_set_u32(f, 7);
+    fail |= fbn_fib_fastdoublingv1(f, big, NULL) != -EINVAL;
+    fail |= fbn_fib_fastdoubling(f, big, NULL) != -EINVAL;
+    fail |= fbn_fib_fastdoubling_dec(f, big, NULL) != -EINVAL;
+    fail |= fbn_fib_defi(f, big, NULL) != -EINVAL;
+    fail |= f->len != 1 || f->num[0] != 7;
+    fail |= fbn_fib_batch(&g, &big, 1, NULL, NULL) != -EINVAL;
+    if (fail)
+        printf("FBN_FIB_MAX_N not enforced\n");
+
+    struct fbn_arena arena;
+    u64 arena_n = fbn_arena_max_n();
+    int bad = arena_n >= FBN_FIB_MAX_N ||
+              fbn_arena_size_fib(arena_n) > FBN_ARENA_MAX ||
+              fbn_arena_size_fib(arena_n + 1) <= FBN_ARENA_MAX ||
+              !fbn_arena_init(&arena, FBN_ARENA_MAX + 1) || arena.base;
+    if (bad)
+        printf("FBN_ARENA_MAX not enforced\n");
+    fail |= bad;
+    fbn_free(f);
+    fbn_free(g);
+    return fail;
+}
+
+/* Every engine counts its steps to the end, and stops when asked to */
+static int test_progress(void)
+{
+    int (*const engine[])(fbn *, u64, struct fbn_progress *) = {
+        fbn_fib_defi,
+        fbn_fib_fastdoubling,
+        fbn_fib_fastdoublingv1,
+        fbn_fib_fastdoubling_dec,
+    };
+    const u64 n = 5000;
+    fbn *f = fbn_alloc(1), *f1 = fbn_alloc(1);
+    int fail = 0;
+
+    for (size_t i = 0; i < sizeof(engine) / sizeof(engine[0]); ++i) {
+        struct fbn_progress prog = {0};
+        fail |= engine[i](f, n, &prog) || prog.n != n || !prog.total ||
+                prog.done != prog.total;
+        prog.abort = true;
+        fail |= engine[i](f, n, &prog) != -EINTR || prog.done >= prog.total;
+    }
+    struct fbn_progress prog = {0};
+    const u64 idx[] = {10, 3000, n};
+    fbn *res[] = {f, f1, f};
+    fail |= fbn_fib_batch(res, idx, 3, NULL, &prog) || prog.n != n ||
+            prog.done != 3 || prog.total != 3;
+    prog.abort = true;
+    fail |= fbn_fib_pair(f, f1, n, &prog) != -EINTR;
+    fail |= fbn_fib_batch(res, idx, 3, NULL, &prog) != -EINTR;
+
+    /* additions from a checkpoint stop before any bit of n is done */
+    fbn_ckpt_size = 1UL << 24;
+    prog.abort = false;
+    fail |= fbn_fib_fastdoublingv1(f, 1000000, &prog);
+    prog.abort = true;
+    fail |= fbn_fib_fastdoublingv1(f, 1001100, &prog) != -EINTR || prog.done;
+    fail |= fbn_fib_fastdoubling(f, 1001100, &prog) != -EINTR || prog.done;
+    fbn_ckpt_free();
+    fbn_ckpt_size = FBN_CKPT_SIZE;
+    if (fail)
+        printf("engine progress or abort mismatch\n");
+    fbn_free(f);
+    fbn_free(f1);
+    return fail;
+}
+
+/*
+ * An engine short of memory fails with -ENOMEM instead of returning a wrong
+ * number: in arenas growing by 64 bytes to fbn_arena_size_fib(n), every run
+ * gives -ENOMEM or F(n), and the full arena gives F(n).
+ */
+static int test_nomem(void)
+{
+    int (*const engine[])(fbn *, u64, struct fbn_progress *) = {
+        fbn_fib_defi,
+        fbn_fib_fastdoubling,
+        fbn_fib_fastdoublingv1,
+        fbn_fib_fastdoubling_dec,
+    };
+    const u64 n = 5000;
+    const size_t full = fbn_arena_size_fib(n);
+    fbn *expect = fbn_alloc(1);
+    int fail = 0;
+
+    fbn_fib_fastdoublingv1(expect, n, NULL);
+    char *expect_str = fbn_printv1(expect);
+    for (size_t i = 0; i < sizeof(engine) / sizeof(engine[0]); ++i) {
+        int nomem = 0, rc = -ENOMEM;
+        for (size_t size = 64; size < full + 64; size += 64) {
+            struct fbn_arena arena;
+            if (fbn_arena_init(&arena, size))
+                return 1;
+            fbn *f = fbn_alloc_arena(&arena, 1);
+            if (f) {
+                rc = engine[i](f, n, NULL);
+                if (rc == -ENOMEM) {
+                    ++nomem;
+                } else if (engine[i] == fbn_fib_fastdoubling_dec) {
+                    char *str = fbn_print_dec(f);
+                    fail |= rc || strcmp(str, expect_str);
+                    free(str);
+                } else {
+                    fail |= rc || !fbn_equal(f, expect);
+                }
+            }
+            fbn_arena_destroy(&arena);
+        }
+        /* the last run had the full arena */
+        fail |= !nomem || rc;
+    }
+    if (fail)
+        printf("engine short of memory mismatch\n");
+    free(expect_str);
+    fbn_free(expect);
+    return fail;
+}
+
+#define NTHREAD 4
+
+/* every thread computes and prints the same numbers as the main thread */
+static const int thread_nfib[] = {100, 5000, 40000, 120000};
+static char *thread_expect[sizeof(thread_nfib) / sizeof(thread_nfib[0])];
+
+static void *thread_fib(void *arg)
+{
+    long fail = 0;
+
+    for (int r = 0; r < 3; ++r) {
+        for (size_t i = 0; i < sizeof(thread_nfib) / sizeof(int); ++i) {
+            /* odd threads use arenas, even ones the shared scratch area */
+            struct fbn_arena arena;
+            int use_arena = ((long) arg + r) & 1;
+            int n = thread_nfib[i];
+            if (use_arena && fbn_arena_init(&arena, fbn_arena_size_fib(n)))
+                return (void *) 1L;
+            fbn *f = use_arena ? fbn_alloc_fib(&arena, n) : fbn_alloc(1);
+            fbn_fib_fastdoublingv1(f, n, NULL);
+            char *str = use_arena ? fbn_printv1_arena(f, &arena)
+                                  : fbn_printv1(f);
+            fail |= !str || strcmp(str, thread_expect[i]);
+            if (use_arena) {
+                fbn_arena_destroy(&arena);
+            } else {
+                free(str);
+                fbn_free(f);
+            }
+        }
+    }
+    return (void *) fail;
+}
+
+/* The engines and the printing are reentrant */
+static int test_threads(void)
+{
+    pthread_t tid[NTHREAD];
+    int fail = 0;
+
+    for (size_t i = 0; i < sizeof(thread_nfib) / sizeof(int); ++i) {
+        fbn *f = fbn_alloc(1);
+        fbn_fib_defi(f, thread_nfib[i], NULL);
+        thread_expect[i] = fbn_print(f);
+        fbn_free(f);
+    }
+    /* the power table is built by the threads */
+    fbn_dec_pow_free();
+    for (long i = 0; i < NTHREAD; ++i)
+        pthread_create(&tid[i], NULL, thread_fib, (void *) i);
+    for (int i = 0; i < NTHREAD; ++i) {
+        void *ret;
+        pthread_join(tid[i], &ret);
+        fail |= ret != NULL;
+    }
+    if (fail)
+        printf("concurrent fbn_fib_fastdoublingv1/fbn_printv1 mismatch\n");
+    for (size_t i = 0; i < sizeof(thread_nfib) / sizeof(int); ++i)
+        free(thread_expect[i]);
+    return fail;
+}
+
+int main(void)
+{
+    srand(0);
+    if (fbn_wq_init())
+        return 1;
+    int fail = test_mul() | test_mul_par() | test_print() | test_raw() |
+               test_fib() | test_ckpt() | test_batch() | test_par() |
+               test_limits() | test_progress() | test_nomem() |
+               test_threads();
+    fbn_wq_destroy();
+    fbn_scratch_free();
+    fbn_dec_pow_free();
+    printf("fbn_test: %s\n", fail ? "FAILED" : "passed");
+    return fail;
+}
@@ -0,0 +1,204 @@
+#include <linux/atomic.h>
+#include <linux/device.h>
+#include <linux/hashtable.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "fib_cache.h"
+#include "fibdrv.h"
+
+/*
+ * Result cache of F(n) keyed by (n, format).
+ *
+ * Hits walk the hash table under rcu_read_lock() only: an entry is pinned by
+ * its reference count and marked referenced, it is not moved. Insertion and
+ * eviction hold fib_cache_lock. Eviction is the CLOCK approximation of LRU:
+ * it scans from the oldest entry and gives every referenced one a second
+ * chance at the head of the list, so exact recency is traded for hits that
+ * never take the lock.
+ */
+#define FIB_CACHE_HASH_BITS 10
+
+static DEFINE_HASHTABLE(fib_cache_hash, FIB_CACHE_HASH_BITS);
+static LIST_HEAD(fib_cache_lru);
+static DEFINE_SPINLOCK(fib_cache_lock);
+/* entries and bytes in the cache, changed under fib_cache_lock */
+static unsigned long fib_cache_nr;
+static unsigned long fib_cache_bytes;
+
+static atomic_long_t fib_cache_hits = ATOMIC_LONG_INIT(0);
+static atomic_long_t fib_cache_misses = ATOMIC_LONG_INIT(0);
+static atomic_long_t fib_cache_evictions = ATOMIC_LONG_INIT(0);
+
+/* byte budget, 0 disables the cache */
+static unsigned long fib_cache_size = FIB_CACHE_SIZE;
+
+static void fib_cache_shrink(unsigned long budget);
+
+static int fib_cache_size_set(const char *val, const struct kernel_param *kp)
+{
+    int rc = param_set_ulong(val, kp);
+    if (unlikely(rc))
+        return rc;
+
+    spin_lock(&fib_cache_lock);
+    fib_cache_shrink(fib_cache_size);
+    spin_unlock(&fib_cache_lock);
+    return 0;
+}
+
+static const struct kernel_param_ops fib_cache_size_ops = {
+    .set = fib_cache_size_set,
+    .get = param_get_ulong,
+};
+module_param_cb(cache_size, &fib_cache_size_ops, &fib_cache_size, 0644);
+MODULE_PARM_DESC(cache_size,
+                 "bytes of the result cache, 0 disables it (default "
+                 __stringify(FIB_CACHE_SIZE) ")");
+
+static inline u64 fib_cache_key(u64 n, int format)
+{
+    return n * FIB_FMT_NR + format;
+}
+
+static void fib_cache_free_rcu(struct rcu_head *rcu)
+{
+    kvfree(container_of(rcu, struct fib_cache_ent, rcu));
+}
+
+void fib_cache_put(struct fib_cache_ent *ent)
+{
+    /* lock-free readers may still see it until a grace period passes */
+    if (refcount_dec_and_test(&ent->ref))
+        call_rcu(&ent->rcu, fib_cache_free_rcu);
+}
+
+struct fib_cache_ent *fib_cache_get(u64 n, int format)
+{
+    struct fib_cache_ent *ent;
+
+    if (!READ_ONCE(fib_cache_size))
+        return NULL;
+
+    rcu_read_lock();
+    hash_for_each_possible_rcu(fib_cache_hash, ent, node,
+                               fib_cache_key(n, format))
+    {
+        /* an entry being evicted has no reference left to take */
+        if (ent->n == n && ent->format == format &&
+            refcount_inc_not_zero(&ent->ref)) {
+            if (!READ_ONCE(ent->referenced))
+                WRITE_ONCE(ent->referenced, true);
+            rcu_read_unlock();
+            atomic_long_inc(&fib_cache_hits);
+            return ent;
+        }
+    }
+    rcu_read_unlock();
+    atomic_long_inc(&fib_cache_misses);
+    return NULL;
+}
+
+/* Evict until the cache fits @budget bytes, call with fib_cache_lock held */
+static void fib_cache_shrink(unsigned long budget)
+{
+    /* every entry gets at most one second chance per shrink */
+    unsigned long scan = fib_cache_nr;
+
+    while (fib_cache_bytes > budget) {
+        struct fib_cache_ent *ent =
+            list_last_entry(&fib_cache_lru, struct fib_cache_ent, lru);
+
+        if (scan && READ_ONCE(ent->referenced)) {
+            --scan;
+            WRITE_ONCE(ent->referenced, false);
+            list_move(&ent->lru, &fib_cache_lru);
+            continue;
+        }
+        hash_del_rcu(&ent->node);
+        list_del(&ent->lru);
+        fib_cache_bytes -= ent->size;
+        --fib_cache_nr;
+        atomic_long_inc(&fib_cache_evictions);
+        fib_cache_put(ent);
+    }
+}
+
+void fib_cache_add(u64 n, int format, const void *data, size_t len)
+{
+    struct fib_cache_ent *ent, *old;
+    size_t size = struct_size(ent, data, len);
+
+    if (size > READ_ONCE(fib_cache_size))
+        return;
+    ent = kvmalloc(size, GFP_KERNEL);
+    if (unlikely(!ent))
+        return;
+    refcount_set(&ent->ref, 1);
+    ent->referenced = false;
+    ent->n = n;
+    ent->format = format;
+    ent->size = size;
+    ent->len = len;
+    memcpy(ent->data, data, len);
+
+    u64 key = fib_cache_key(n, format);
+    spin_lock(&fib_cache_lock);
+    /* another caller may have computed the same number meanwhile */
+    hash_for_each_possible(fib_cache_hash, old, node, key)
+    {
+        if (old->n == n && old->format == format) {
+            spin_unlock(&fib_cache_lock);
+            kvfree(ent);
+            return;
+        }
+    }
+    hash_add_rcu(fib_cache_hash, &ent->node, key);
+    list_add(&ent->lru, &fib_cache_lru);
+    fib_cache_bytes += size;
+    ++fib_cache_nr;
+    fib_cache_shrink(fib_cache_size);
+    spin_unlock(&fib_cache_lock);
+}
+
+void fib_cache_clear(void)
+{
+    spin_lock(&fib_cache_lock);
+    fib_cache_shrink(0);
+    spin_unlock(&fib_cache_lock);
+    /* the entries are freed by RCU callbacks of this module */
+    rcu_barrier();
+}
+
+#define FIB_CACHE_ATTR(name, value)                                    \
+    static ssize_t cache_##name##_show(struct device *dev,             \
+                                       struct device_attribute *attr, \
+                                       char *buf)                     \
+    {                                                                  \
+        return sprintf(buf, "%lu\n", (unsigned long) (value));         \
+    }                                                                  \
+    static DEVICE_ATTR_RO(cache_##name)
+
+FIB_CACHE_ATTR(hits, atomic_long_read(&fib_cache_hits));
+FIB_CACHE_ATTR(misses, atomic_long_read(&fib_cache_misses));
+FIB_CACHE_ATTR(evictions, atomic_long_read(&fib_cache_evictions));
+FIB_CACHE_ATTR(entries, READ_ONCE(fib_cache_nr));
+FIB_CACHE_ATTR(bytes, READ_ONCE(fib_cache_bytes));
+
+static struct attribute *fib_cache_attrs[] = {
+    &dev_attr_cache_hits.attr,      &dev_attr_cache_misses.attr,
+    &dev_attr_cache_evictions.attr, &dev_attr_cache_entries.attr,
+    &dev_attr_cache_bytes.attr,     NULL,
+};
+
+static const struct attribute_group fib_cache_group = {
+    .attrs = fib_cache_attrs,
+};
+
+const struct attribute_group *fib_cache_groups[] = {
+    &fib_cache_group,
+    NULL,
+};
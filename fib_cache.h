@@ -0,0 +1,55 @@
+#ifndef __FIB_CACHE_H_
+#define __FIB_CACHE_H_
+
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/refcount.h>
+#include <linux/sysfs.h>
+#include <linux/types.h>
+
+/*
+ * Cached result of the driver: F(n) rendered in one format, the bytes the
+ * result region of an open file would hold.
+ * [node], [lru] links of the hash table and the eviction list
+ * [ref] references of the cache itself and of the users holding it
+ * [referenced] hit since the eviction scan passed it last
+ * [size] bytes charged to the budget
+ * [data] the [len] bytes of F([n]) in [format]
+ */
+struct fib_cache_ent {
+    struct hlist_node node;
+    struct list_head lru;
+    struct rcu_head rcu;
+    refcount_t ref;
+    bool referenced;
+    u64 n;
+    int format;
+    size_t size;
+    size_t len;
+    char data[];
+};
+
+/* Default bytes of the result cache, module parameter cache_size */
+#define FIB_CACHE_SIZE 16777216 /* 16 MiB */
+
+/*
+ * Look up F(n) in @format without taking a lock.
+ * Return the entry with a reference held, release it by fib_cache_put(), or
+ * NULL on a miss.
+ */
+struct fib_cache_ent *fib_cache_get(u64 n, int format);
+/* Drop a reference taken by fib_cache_get() */
+void fib_cache_put(struct fib_cache_ent *ent);
+/*
+ * Copy @len bytes of F(n) in @format into the cache, evicting the entries
+ * used least recently until it fits the budget. Best effort: nothing is kept
+ * if the copy cannot be allocated or is larger than the budget.
+ */
+void fib_cache_add(u64 n, int format, const void *data, size_t len);
+/* Drop every entry and wait for them to be freed, before unloading */
+void fib_cache_clear(void);
+
+/* Read-only counters of the cache for the device's sysfs directory */
+extern const struct attribute_group *fib_cache_groups[];
+
+#endif /* __FIB_CACHE_H_ */
@@ -1,14 +1,29 @@
 #include <linux/cdev.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kdev_t.h>
 #include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "bn_fib.h"
+#include "fib_cache.h"
+#include "fibdrv.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -21,12 +36,119 @@ MODULE_VERSION("0.1");
  * ssize_t can't fit the number > 92
  */
 //#define MAX_LENGTH 92
+/*
+ * Largest offset of the decimal read() and write(), their callers have no way
+ * to tell the size of their buffers
+ */
 #define MAX_LENGTH 10000
+/* Default of max_n */
+#define FIB_MAX_N 100000000
 
 static dev_t fib_dev = 0;
 static struct cdev *fib_cdev;
 static struct class *fib_class;
-static DEFINE_MUTEX(fib_mutex);
+/* Runs the jobs of FIB_IOC_SUBMIT, drained before the module goes away */
+static struct workqueue_struct *fib_wq;
+/* Every open file, listed by the progress file of debugfs */
+static LIST_HEAD(fib_files);
+static DEFINE_MUTEX(fib_files_lock);
+static struct dentry *fib_debugfs;
+
+module_param_named(karatsuba_threshold, fbn_karatsuba_threshold, int, 0444);
+MODULE_PARM_DESC(karatsuba_threshold,
+                 "limb threshold to multiply by Karatsuba (default "
+                 __stringify(FBN_KARATSUBA_THRESHOLD) ")");
+module_param_named(karatsuba_sqr_threshold,
+                   fbn_karatsuba_sqr_threshold,
+                   int,
+                   0444);
+MODULE_PARM_DESC(karatsuba_sqr_threshold,
+                 "limb threshold to square by Karatsuba (default "
+                 __stringify(FBN_KARATSUBA_SQR_THRESHOLD) ")");
+module_param_named(toom3_threshold, fbn_toom3_threshold, int, 0444);
+MODULE_PARM_DESC(toom3_threshold,
+                 "limb threshold to multiply by Toom-3 (default "
+                 __stringify(FBN_TOOM3_THRESHOLD) ")");
+module_param_named(toom3_sqr_threshold, fbn_toom3_sqr_threshold, int, 0444);
+MODULE_PARM_DESC(toom3_sqr_threshold,
+                 "limb threshold to square by Toom-3 (default "
+                 __stringify(FBN_TOOM3_SQR_THRESHOLD) ")");
+#ifdef FBN_HAVE_NTT
+module_param_named(ntt_threshold, fbn_ntt_threshold, int, 0444);
+MODULE_PARM_DESC(ntt_threshold,
+                 "limb threshold to multiply by NTT (default "
+                 __stringify(FBN_NTT_THRESHOLD) ")");
+module_param_named(mul_workers, fbn_mul_workers, int, 0444);
+MODULE_PARM_DESC(mul_workers,
+                 "CPUs one NTT product may use, 1 for serial (default "
+                 __stringify(FBN_MUL_WORKERS) ")");
+module_param_named(mul_grain, fbn_mul_grain, int, 0444);
+MODULE_PARM_DESC(mul_grain,
+                 "limbs of the shorter operand to multiply on several CPUs "
+                 "(default " __stringify(FBN_MUL_GRAIN) ")");
+#endif
+module_param_named(par_threshold, fbn_par_threshold, int, 0444);
+MODULE_PARM_DESC(par_threshold,
+                 "limb threshold to run the products of a doubling step on "
+                 "three CPUs (default " __stringify(FBN_PAR_THRESHOLD) ")");
+module_param_named(dec_dc_threshold, fbn_dec_dc_threshold, int, 0444);
+MODULE_PARM_DESC(dec_dc_threshold,
+                 "limb threshold to print by divide-and-conquer (default "
+                 __stringify(FBN_DEC_DC_THRESHOLD) ")");
+module_param_named(dec_par_threshold, fbn_dec_par_threshold, int, 0444);
+MODULE_PARM_DESC(dec_par_threshold,
+                 "limb threshold to print the halves of a number on two "
+                 "CPUs (default " __stringify(FBN_DEC_PAR_THRESHOLD) ")");
+
+/* A new budget starts the checkpoints over */
+static int fib_ckpt_size_set(const char *val, const struct kernel_param *kp)
+{
+    int rc = param_set_ulong(val, kp);
+    if (likely(!rc))
+        fbn_ckpt_free();
+    return rc;
+}
+
+static const struct kernel_param_ops fib_ckpt_size_ops = {
+    .set = fib_ckpt_size_set,
+    .get = param_get_ulong,
+};
+module_param_cb(ckpt_size, &fib_ckpt_size_ops, &fbn_ckpt_size, 0644);
+MODULE_PARM_DESC(ckpt_size,
+                 "bytes of fast doubling checkpoints, 0 disables them "
+                 "(default " __stringify(FBN_CKPT_SIZE) ")");
+
+/*
+ * Largest index of lseek(), the sequential read() and the ioctls, F(max_n)
+ * takes about max_n / 11.5 bytes in raw format
+ */
+static unsigned long long max_n = FIB_MAX_N;
+
+/*
+ * fbn_fib_pair(n) and the range F(n), F(n + 1) need n < FBN_FIB_MAX_N, and
+ * the arena of fib_render() must stay within FBN_ARENA_MAX
+ */
+static int fib_max_n_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned long long n;
+    int rc = kstrtoull(val, 0, &n);
+    if (unlikely(rc))
+        return rc;
+    if (n >= FBN_FIB_MAX_N || n > fbn_arena_max_n())
+        return -EINVAL;
+    WRITE_ONCE(max_n, n);
+    return 0;
+}
+
+static const struct kernel_param_ops fib_max_n_ops = {
+    .set = fib_max_n_set,
+    .get = param_get_ullong,
+};
+module_param_cb(max_n, &fib_max_n_ops, &max_n, 0644);
+MODULE_PARM_DESC(max_n,
+                 "largest index of the ioctls and the sequential read, up to "
+                 "a 2 GiB arena per computation (default "
+                 __stringify(FIB_MAX_N) ")");
 
 static long long fib_sequence(long long k)
 {
@@ -210,31 +332,224 @@ static long long fibseq_fastdoubling_clz(long long k)
     return a;
 }
 
-static int fib_open(struct inode *inode, struct file *file)
+/*
+ * State of an open file.
+ * [lock] serializes the users of the result region
+ * [format] output format of read(), enum fib_format
+ * [out] result region of [out_size] bytes, user space can mmap it
+ * [out_len] bytes of F(out_n) at [out], 0 if nothing is kept
+ * [out_format], [out_engine] how F(out_n) is kept, [out_time_ns] the time
+ *                            the engine took
+ * [seq] sequential mode, read() returns F(f_pos) and advances f_pos
+ * [seq_a], [seq_b] F(seq_n - 1) and F(seq_n) of the sequential mode, NULL
+ *                  before the first read
+ * [ref] held by the open file and by a queued job
+ * [job] work item of FIB_IOC_SUBMIT on fib_wq, rendering F(job_n) in
+ *       [job_format] into the result region under [lock]
+ * [job_state] enum fib_job_state, read without [lock] by poll() and the
+ *             nonblocking read()
+ * [job_rc] what fib_render() returned for the job
+ * [wait] woken when the job is done
+ * [closed] the file is released, a job not started yet is dropped
+ * [prog] progress of the engine run for this file, read without [lock]
+ * [pid] the process which opened the file
+ * [node] in fib_files
+ */
+struct fib_file {
+    struct kref ref;
+    struct mutex lock;
+    int format;
+    loff_t out_n;
+    int out_format;
+    int out_engine;
+    s64 out_time_ns;
+    void *out;
+    size_t out_size;
+    size_t out_len;
+    bool seq;
+    loff_t seq_n;
+    fbn *seq_a;
+    fbn *seq_b;
+    struct work_struct job;
+    u64 job_n;
+    int job_format;
+    int job_state;
+    int job_rc;
+    wait_queue_head_t wait;
+    bool closed;
+    struct fbn_progress prog;
+    pid_t pid;
+    struct list_head node;
+};
+
+/*
+ * [FIB_JOB_NONE] no job, read() computes on the spot
+ * [FIB_JOB_PENDING] queued or running
+ * [FIB_JOB_DONE] the result waits for read()
+ */
+enum fib_job_state {
+    FIB_JOB_NONE,
+    FIB_JOB_PENDING,
+    FIB_JOB_DONE,
+};
+
+static int fib_render(struct fib_file *ff, loff_t n, int format, int engine);
+
+static void fib_file_free(struct kref *ref)
 {
-    if (!mutex_trylock(&fib_mutex)) {
-        printk(KERN_ALERT "fibdrv is in use");
-        return -EBUSY;
+    struct fib_file *ff = container_of(ref, struct fib_file, ref);
+
+    mutex_lock(&fib_files_lock);
+    list_del(&ff->node);
+    mutex_unlock(&fib_files_lock);
+    /* pages still mapped by user space are freed on munmap */
+    vfree(ff->out);
+    fbn_free(ff->seq_a);
+    fbn_free(ff->seq_b);
+    mutex_destroy(&ff->lock);
+    kfree(ff);
+}
+
+/* The job of FIB_IOC_SUBMIT, skipped if the file was closed meanwhile */
+static void fib_job_run(struct work_struct *work)
+{
+    struct fib_file *ff = container_of(work, struct fib_file, job);
+
+    mutex_lock(&ff->lock);
+    if (!READ_ONCE(ff->closed)) {
+        ff->job_rc =
+            fib_render(ff, ff->job_n, ff->job_format, FIB_ENG_FASTDBLv1);
+        WRITE_ONCE(ff->job_state, FIB_JOB_DONE);
     }
+    mutex_unlock(&ff->lock);
+    wake_up_interruptible_poll(&ff->wait, EPOLLIN | EPOLLRDNORM);
+    kref_put(&ff->ref, fib_file_free);
+}
+
+/* Every open file has its own state, so any number of them may compute */
+static int fib_open(struct inode *inode, struct file *file)
+{
+    struct fib_file *ff = kzalloc(sizeof(struct fib_file), GFP_KERNEL);
+    if (unlikely(!ff))
+        return -ENOMEM;
+    kref_init(&ff->ref);
+    mutex_init(&ff->lock);
+    INIT_WORK(&ff->job, fib_job_run);
+    init_waitqueue_head(&ff->wait);
+    ff->pid = task_tgid_nr(current);
+    mutex_lock(&fib_files_lock);
+    list_add_tail(&ff->node, &fib_files);
+    mutex_unlock(&fib_files_lock);
+    file->private_data = ff;
     return 0;
 }
 
+/*
+ * close() does not wait for a job: one not started yet is dropped, a running
+ * one stops at its next step and frees the file.
+ */
 static int fib_release(struct inode *inode, struct file *file)
 {
-    mutex_unlock(&fib_mutex);
+    struct fib_file *ff = file->private_data;
+
+    WRITE_ONCE(ff->closed, true);
+    WRITE_ONCE(ff->prog.abort, true);
+    kref_put(&ff->ref, fib_file_free);
     return 0;
 }
 
-static char *(*const bn_print[])(const fbn *) = {
-    fbn_print,   /* 0 */
-    fbn_printv1, /* 1 */
-};
-#define BN_PRINT 1
+/*
+ * Decimal strings of F(0..MAX_LENGTH), each with its '\0', precomputed at
+ * load time if the module parameter precompute is set: F(n) is the bytes of
+ * fib_table from fib_table_off[n] to fib_table_off[n + 1].
+ */
+static bool precompute;
+module_param(precompute, bool, 0444);
+MODULE_PARM_DESC(precompute,
+                 "precompute the decimal F(0.." __stringify(
+                     MAX_LENGTH) ") at load time");
+static char *fib_table;
+static u32 *fib_table_off;
+
+static void fib_table_free(void)
+{
+    vfree(fib_table);
+    kvfree(fib_table_off);
+    fib_table = NULL;
+    fib_table_off = NULL;
+}
+
+/*
+ * Build the table by one fbn_add() per number.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int __init fib_table_init(void)
+{
+    size_t size = 0;
+    /* F(n) has floor(n * log10(phi)) + 1 digits at most, plus the '\0' */
+    for (int n = 0; n <= MAX_LENGTH; ++n)
+        size += (u64) n * 20899 / 100000 + 2;
 
-static void (*const bn_fibonacci_seq[])(fbn *, int) = {
-    fbn_fib_defi,           /* 0 */
-    fbn_fib_fastdoubling,   /* 1 */
-    fbn_fib_fastdoublingv1, /* 2 */
+    ktime_t kt = ktime_get();
+    int cap = fbn_fib_cap(MAX_LENGTH + 1);
+    fbn *a = fbn_alloc(cap), *b = fbn_alloc(cap);
+    int rc = -ENOMEM;
+    fib_table = vmalloc(size);
+    fib_table_off = kvmalloc_array(MAX_LENGTH + 2, sizeof(u32), GFP_KERNEL);
+    if (unlikely(!fib_table || !fib_table_off || !a || !b))
+        goto out;
+
+    u32 off = 0;
+    fbn_set_u32(a, 1); /* F(-1) */
+    fbn_set_u32(b, 0);
+    for (int n = 0; n <= MAX_LENGTH; ++n) {
+        char *str = fbn_printv1(b);
+        if (unlikely(!str))
+            goto out;
+        size_t len = strlen(str) + 1;
+        fib_table_off[n] = off;
+        memcpy(fib_table + off, str, len);
+        off += len;
+        kvfree(str);
+        if (unlikely(fbn_add(a, a, b))) /* a = F(n + 1) */
+            goto out;
+        fbn *tmp = a; /* a = F(n), b = F(n + 1) */
+        a = b;
+        b = tmp;
+    }
+    fib_table_off[MAX_LENGTH + 1] = off;
+    kt = ktime_sub(ktime_get(), kt);
+    pr_info("fibdrv: precomputed F(0..%d) in %lld us, %u bytes of strings "
+            "(%zu allocated) and %zu bytes of index\n",
+            MAX_LENGTH, ktime_to_us(kt), off, size,
+            (MAX_LENGTH + 2) * sizeof(u32));
+    rc = 0;
+out:
+    fbn_free(a);
+    fbn_free(b);
+    if (unlikely(rc))
+        fib_table_free();
+    return rc;
+}
+
+/*
+ * Precomputed decimal F(n), or NULL if there is none.
+ * @len: bytes of the string with its '\0'
+ */
+static const char *fib_table_get(loff_t n, size_t *len)
+{
+    if (!fib_table || n < 0 || n > MAX_LENGTH)
+        return NULL;
+    *len = fib_table_off[n + 1] - fib_table_off[n];
+    return fib_table + fib_table_off[n];
+}
+
+/* indexed by enum fib_engine */
+static int (*const bn_fibonacci_seq[])(fbn *, u64, struct fbn_progress *) = {
+    fbn_fib_defi,             /* 0 */
+    fbn_fib_fastdoubling,     /* 1 */
+    fbn_fib_fastdoublingv1,   /* 2 */
+    fbn_fib_fastdoubling_dec, /* 3, decimal-native */
 };
 
 #if 0
@@ -246,28 +561,351 @@ static inline void escape(void *p)
 }
 #endif
 
+/*
+ * Make the result region hold at least @len bytes. The region is reused
+ * while it is large enough, so a mapping of it sees the new result in place.
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fib_out_reserve(struct fib_file *ff, size_t len)
+{
+    if (len <= ff->out_size)
+        return 0;
+    vfree(ff->out);
+    ff->out_size = 0;
+    ff->out = vmalloc_user(PAGE_ALIGN(len));
+    if (unlikely(!ff->out))
+        return -ENOMEM;
+    ff->out_size = PAGE_ALIGN(len);
+    return 0;
+}
+
+/* Record that the region holds @len bytes of F(n) */
+static void fib_out_done(struct fib_file *ff,
+                         loff_t n,
+                         int format,
+                         int engine,
+                         s64 time_ns,
+                         size_t len)
+{
+    /* no stale bytes of a longer result behind this one */
+    memset(ff->out + len, 0, ff->out_size - len);
+    ff->out_n = n;
+    ff->out_format = format;
+    ff->out_engine = engine;
+    ff->out_time_ns = time_ns;
+    ff->out_len = len;
+}
+
+/* Put @len bytes of F(n) rendered already into the result region */
+static int fib_out_copy(struct fib_file *ff,
+                        loff_t n,
+                        int format,
+                        int engine,
+                        const void *data,
+                        size_t len)
+{
+    int rc = fib_out_reserve(ff, len);
+    if (likely(!rc)) {
+        memcpy(ff->out, data, len);
+        fib_out_done(ff, n, format, engine, 0, len);
+    }
+    return rc;
+}
+
+/*
+ * Write F(n) into the result region of the open file. Nothing is computed if
+ * F(n) is kept in the same format by the same engine already, or if the
+ * precomputed table or the result cache has it (then the time is 0). Call
+ * with ff->lock held.
+ * @format: enum fib_format, only FIB_FMT_DEC if @engine is FIB_ENG_DEC
+ * @engine: enum fib_engine
+ * Return 0 on success, -EINTR if the engine was stopped and -ENOMEM on
+ * failure.
+ */
+static int fib_render(struct fib_file *ff, loff_t n, int format, int engine)
+{
+    if (ff->out_len && ff->out_n == n && ff->out_format == format &&
+        ff->out_engine == engine)
+        return 0;
+    ff->out_len = 0;
+
+    /* every engine gives the same bytes */
+    size_t len;
+    const char *pre = format == FIB_FMT_DEC ? fib_table_get(n, &len) : NULL;
+    if (pre)
+        return fib_out_copy(ff, n, format, engine, pre, len);
+    struct fib_cache_ent *ent = fib_cache_get(n, format);
+    if (ent) {
+        int rc = fib_out_copy(ff, n, format, engine, ent->data, ent->len);
+        fib_cache_put(ent);
+        return rc;
+    }
+
+    struct fbn_arena arena;
+    if (unlikely(fbn_arena_init(&arena, fbn_arena_size_fib(n)) < 0))
+        return -ENOMEM;
+    fbn *fib = fbn_alloc_fib(&arena, n);
+    char *str = NULL, *bin = NULL;
+    int rc = -ENOMEM;
+    if (unlikely(!fib))
+        goto out;
+    ktime_t kt = ktime_get();
+    rc = bn_fibonacci_seq[engine](fib, n, &ff->prog);
+    kt = ktime_sub(ktime_get(), kt);
+    if (unlikely(rc))
+        goto out;
+    rc = -ENOMEM;
+
+    /*
+     * Render into kernel memory first: the cache is shared by every open
+     * file and must not be filled from the region user space maps.
+     */
+    switch (format) {
+    case FIB_FMT_RAW:
+        len = fbn_raw_size(fib);
+        str = bin = kvmalloc(len, GFP_KERNEL);
+        if (unlikely(!bin))
+            goto out;
+        fbn_to_raw(fib, (u8 *) bin);
+        break;
+    case FIB_FMT_HEX:
+        len = fbn_hex_size(fib);
+        str = bin = kvmalloc(len, GFP_KERNEL);
+        if (unlikely(!bin))
+            goto out;
+        fbn_to_hex(fib, bin);
+        break;
+    default:
+        str = engine == FIB_ENG_DEC ? fbn_print_dec_arena(fib, &arena)
+                                    : fbn_printv1_arena(fib, &arena);
+        if (unlikely(!str))
+            goto out;
+        len = strlen(str) + 1;
+        break;
+    }
+    fib_cache_add(n, format, str, len);
+    if (unlikely(fib_out_reserve(ff, len)))
+        goto out;
+    memcpy(ff->out, str, len);
+    fib_out_done(ff, n, format, engine, ktime_to_ns(kt), len);
+    rc = 0;
+out:
+    kvfree(bin);
+    fbn_arena_destroy(&arena);
+    return rc;
+}
+
+/* read() in raw or hex format, @size is the length of @buf */
+static ssize_t fib_read_bin(struct fib_file *ff,
+                            char *buf,
+                            size_t size,
+                            loff_t n)
+{
+    if (unlikely(n > READ_ONCE(max_n)))
+        return -EINVAL;
+
+    mutex_lock(&ff->lock);
+    ssize_t rc = fib_render(ff, n, ff->format, FIB_ENG_FASTDBLv1);
+    if (unlikely(rc))
+        goto out;
+    rc = -EOVERFLOW;
+    if (size < ff->out_len)
+        goto out;
+    rc = copy_to_user(buf, ff->out, ff->out_len) ? -EFAULT : ff->out_len;
+out:
+    mutex_unlock(&ff->lock);
+    return rc;
+}
+
+/*
+ * Move the pair of the sequential mode to F(n - 1), F(n): one addition or
+ * subtraction from the neighbours, fast doubling from anywhere else.
+ * Call with ff->lock held.
+ * Return 0 on success, -EINTR if the engine was stopped and -ENOMEM on
+ * failure.
+ */
+static int fib_seq_move(struct fib_file *ff, loff_t n)
+{
+    if (!ff->seq_a) {
+        ff->seq_a = fbn_alloc(1);
+        ff->seq_b = fbn_alloc(1);
+        if (unlikely(!ff->seq_a || !ff->seq_b)) {
+            fbn_free(ff->seq_a);
+            fbn_free(ff->seq_b);
+            ff->seq_a = ff->seq_b = NULL;
+            return -ENOMEM;
+        }
+        ff->seq_n = -1; /* nothing kept */
+    }
+
+    fbn *a = ff->seq_a, *b = ff->seq_b;
+    int rc = 0;
+    if (n == ff->seq_n)
+        return 0;
+    if (ff->seq_n >= 0 && n == ff->seq_n + 1) {
+        rc = fbn_add(a, a, b); /* a = F(n) */
+        ff->seq_a = b;
+        ff->seq_b = a;
+    } else if (ff->seq_n >= 1 && n == ff->seq_n - 1) {
+        rc = fbn_sub(b, b, a); /* b = F(n - 1) */
+        ff->seq_a = b;
+        ff->seq_b = a;
+    } else if (n) {
+        rc = fbn_fib_pair(a, b, n - 1, &ff->prog);
+    } else {
+        fbn_set_u32(a, 1); /* F(-1) */
+        fbn_set_u32(b, 0);
+    }
+    /* the pair is garbage on failure */
+    ff->seq_n = likely(!rc) ? n : -1;
+    return rc;
+}
+
+/*
+ * read() of the sequential mode, @size is the length of @buf.
+ * Return the bytes copied and advance *offset, or 0 after F(max_n).
+ */
+static ssize_t fib_read_seq(struct fib_file *ff,
+                            char *buf,
+                            size_t size,
+                            loff_t *offset)
+{
+    if (*offset > READ_ONCE(max_n))
+        return 0;
+
+    mutex_lock(&ff->lock);
+    ssize_t rc = fib_seq_move(ff, *offset);
+    char *out = NULL;
+    size_t len;
+    if (unlikely(rc))
+        goto out;
+
+    const fbn *f = ff->seq_b;
+    rc = -ENOMEM;
+    switch (ff->format) {
+    case FIB_FMT_RAW:
+        len = fbn_raw_size(f);
+        out = kvmalloc(len, GFP_KERNEL);
+        if (likely(out))
+            fbn_to_raw(f, (u8 *) out);
+        break;
+    case FIB_FMT_HEX:
+        len = fbn_hex_size(f);
+        out = kvmalloc(len, GFP_KERNEL);
+        if (likely(out))
+            fbn_to_hex(f, out);
+        break;
+    default:
+        out = fbn_printv1(f);
+        len = out ? strlen(out) + 1 : 0;
+        break;
+    }
+    if (unlikely(!out))
+        goto out;
+    rc = -EOVERFLOW;
+    if (size < len)
+        goto out;
+    rc = -EFAULT;
+    if (copy_to_user(buf, out, len))
+        goto out;
+    ++*offset;
+    rc = len;
+out:
+    kvfree(out);
+    mutex_unlock(&ff->lock);
+    return rc;
+}
+
+/*
+ * read() of the job of FIB_IOC_SUBMIT, @size is the length of @buf. Wait for
+ * the job, or fail with -EAGAIN under O_NONBLOCK, then copy the result and
+ * forget the job unless @buf is too small.
+ */
+static ssize_t fib_read_job(struct fib_file *ff,
+                            struct file *file,
+                            char *buf,
+                            size_t size)
+{
+    if (file->f_flags & O_NONBLOCK) {
+        if (READ_ONCE(ff->job_state) == FIB_JOB_PENDING ||
+            !mutex_trylock(&ff->lock))
+            return -EAGAIN;
+    } else {
+        if (wait_event_interruptible(
+                ff->wait, READ_ONCE(ff->job_state) != FIB_JOB_PENDING))
+            return -ERESTARTSYS;
+        mutex_lock(&ff->lock);
+    }
+
+    ssize_t rc = -EAGAIN;
+    if (ff->job_state != FIB_JOB_DONE) /* taken by another reader */
+        goto out;
+    /* a later request may have reused the region, render it again */
+    rc = ff->job_rc;
+    if (likely(!rc))
+        rc = fib_render(ff, ff->job_n, ff->job_format, FIB_ENG_FASTDBLv1);
+    if (unlikely(rc))
+        goto done;
+    rc = -EOVERFLOW;
+    if (size < ff->out_len)
+        goto out;
+    rc = copy_to_user(buf, ff->out, ff->out_len) ? -EFAULT : ff->out_len;
+done:
+    WRITE_ONCE(ff->job_state, FIB_JOB_NONE);
+out:
+    mutex_unlock(&ff->lock);
+    return rc;
+}
+
 /* calculate the fibonacci number at given offset */
 static ssize_t fib_read(struct file *file,
                         char *buf,
                         size_t method,
                         loff_t *offset)
 {
+    struct fib_file *ff = file->private_data;
+    if (READ_ONCE(ff->job_state) != FIB_JOB_NONE)
+        return fib_read_job(ff, file, buf, method);
+    if (ff->seq)
+        return fib_read_seq(ff, buf, method, offset);
+    if (ff->format != FIB_FMT_DEC)
+        return fib_read_bin(ff, buf, method, *offset);
+    /* the engine table is indexed by the size argument */
+    if (unlikely(method >= FIB_ENG_NR))
+        return -EINVAL;
+
+    /* pread() skips lseek(), a negative offset compares above max_n */
+    if (unlikely(*offset > READ_ONCE(max_n)))
+        return -EINVAL;
+
 #ifdef _TEST_KTIME
-    fbn *fib = fbn_alloc(1);
+    struct fbn_arena arena;
+    if (unlikely(fbn_arena_init(&arena, fbn_arena_size_fib(*offset)) < 0))
+        return -ENOMEM;
+    fbn *fib = fbn_alloc_fib(&arena, *offset);
+    ssize_t rc = -ENOMEM;
+    if (unlikely(!fib))
+        goto out;
 
     ktime_t kt = ktime_get();
-    bn_fibonacci_seq[method](fib, *offset);
+    rc = bn_fibonacci_seq[method](fib, *offset, NULL);
     kt = ktime_sub(ktime_get(), kt);
-
-    fbn_free(fib);
-    return (ssize_t) ktime_to_ns(kt);
+    if (likely(!rc))
+        rc = (ssize_t) ktime_to_ns(kt);
+out:
+    fbn_arena_destroy(&arena);
+    return rc;
 #elif defined(_PERF_EVT)
 #define REPEAT (200 * 1000)
 
     for (int i = 0; i < REPEAT; ++i) {
-        fbn *fib = fbn_alloc(1);
-        bn_fibonacci_seq[method](fib, *offset);
+        fbn *fib = fbn_alloc(fbn_fib_cap(*offset));
+        if (unlikely(!fib))
+            return -ENOMEM;
+        int rc = bn_fibonacci_seq[method](fib, *offset, NULL);
         fbn_free(fib);
+        if (unlikely(rc))
+            return rc;
     }
 
     return 0;
@@ -277,10 +915,10 @@ static ssize_t fib_read(struct file *file,
     char *str = NULL;
 
     for (int i = 0; i < 5; ++i) {
-        fbn_fib_fastdoublingv1(a, i);
+        fbn_fib_fastdoublingv1(a, i, NULL);
         str = fbn_printv1(a);
         pr_info("fibdrv_debug: str %s\n", str);
-        kfree(str);
+        kvfree(str);
     }
     fbn_lshift(a, 32);
     fbndebug_printhex(a);
@@ -288,12 +926,43 @@ static ssize_t fib_read(struct file *file,
     fbn_free(a);
     return 0;
 #else /* normal read */
-    fbn *fib = fbn_alloc(1);
-    bn_fibonacci_seq[method](fib, *offset);
-    char *str = bn_print[BN_PRINT](fib);
-    ssize_t left = copy_to_user(buf, str, strlen(str) + 1);
-    kfree(str);
-    fbn_free(fib);
+    /* the size argument is the method, the buffer has room for MAX_LENGTH */
+    if (unlikely(*offset > MAX_LENGTH))
+        return -EOVERFLOW;
+    size_t len;
+    const char *pre = fib_table_get(*offset, &len);
+    if (pre)
+        return copy_to_user(buf, pre, len);
+
+    ssize_t left;
+    struct fib_cache_ent *ent = fib_cache_get(*offset, FIB_FMT_DEC);
+    if (ent) {
+        left = copy_to_user(buf, ent->data, ent->len);
+        fib_cache_put(ent);
+        return left;
+    }
+
+    /* one arena holds every fbn temporary and the string of this request */
+    struct fbn_arena arena;
+    if (unlikely(fbn_arena_init(&arena, fbn_arena_size_fib(*offset)) < 0))
+        return -ENOMEM;
+    fbn *fib = fbn_alloc_fib(&arena, *offset);
+    left = -ENOMEM;
+    if (unlikely(!fib))
+        goto out;
+    left = bn_fibonacci_seq[method](fib, *offset, &ff->prog);
+    if (unlikely(left))
+        goto out;
+    left = -ENOMEM;
+    char *str = method == FIB_ENG_DEC ? fbn_print_dec_arena(fib, &arena)
+                                     : fbn_printv1_arena(fib, &arena);
+    if (unlikely(!str))
+        goto out;
+    len = strlen(str) + 1;
+    left = copy_to_user(buf, str, len);
+    fib_cache_add(*offset, FIB_FMT_DEC, str, len);
+out:
+    fbn_arena_destroy(&arena);
     return left;
 #endif
 }
@@ -326,6 +995,9 @@ static ssize_t fib_write(struct file *file,
                          size_t method,
                          loff_t *offset)
 {
+    /* fib_sequence() keeps every number on the stack */
+    if (unlikely(*offset > MAX_LENGTH || method >= ARRAY_SIZE(fibonacci_seq)))
+        return -EINVAL;
 #ifdef _TEST_KTIME
     return (ssize_t) FIB_KTIME(method, *offset);
 #else
@@ -335,7 +1007,7 @@ static ssize_t fib_write(struct file *file,
 
 static loff_t fib_device_lseek(struct file *file, loff_t offset, int orig)
 {
-    loff_t new_pos = 0;
+    loff_t new_pos = 0, end = READ_ONCE(max_n);
     switch (orig) {
     case 0: /* SEEK_SET: */
         new_pos = offset;
@@ -344,18 +1016,494 @@ static loff_t fib_device_lseek(struct file *file, loff_t offset, int orig)
         new_pos = file->f_pos + offset;
         break;
     case 2: /* SEEK_END: */
-        new_pos = MAX_LENGTH - offset;
+        new_pos = end - offset;
         break;
     }
 
-    if (new_pos > MAX_LENGTH)
-        new_pos = MAX_LENGTH;  // max case
+    if (new_pos > end)
+        new_pos = end;      // max case
     if (new_pos < 0)
         new_pos = 0;        // min case
     file->f_pos = new_pos;  // This is what we'll use now
     return new_pos;
 }
 
+/* FIB_IOC_REQUEST, call with ff->lock held */
+static long fib_ioctl_request(struct fib_file *ff, struct fib_req __user *ureq)
+{
+    struct fib_req req;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (req.version != FIB_REQ_VERSION || req.reserved ||
+        req.engine >= FIB_ENG_NR || req.format >= FIB_FMT_NR ||
+        (req.engine == FIB_ENG_DEC && req.format != FIB_FMT_DEC) ||
+        req.n > READ_ONCE(max_n))
+        return -EINVAL;
+
+    long rc = fib_render(ff, req.n, req.format, req.engine);
+    if (unlikely(rc))
+        return rc;
+    req.required = ff->out_len;
+    req.time_ns = ff->out_time_ns;
+    req.written = 0;
+    if (req.len < ff->out_len) {
+        rc = -ENOSPC;
+    } else if (copy_to_user(u64_to_user_ptr(req.buf), ff->out,
+                            ff->out_len)) {
+        return -EFAULT;
+    } else {
+        req.written = ff->out_len;
+    }
+    if (copy_to_user(ureq, &req, sizeof(req)))
+        return -EFAULT;
+    return rc;
+}
+
+/* FIB_IOC_GET_PROGRESS, without ff->lock held by the computation watched */
+static long fib_ioctl_progress(struct fib_file *ff,
+                               struct fib_progress __user *uprog)
+{
+    struct fib_progress prog = {
+        .n = READ_ONCE(ff->prog.n),
+        .done = READ_ONCE(ff->prog.done),
+        .total = READ_ONCE(ff->prog.total),
+    };
+
+    return copy_to_user(uprog, &prog, sizeof(prog)) ? -EFAULT : 0;
+}
+
+/* FIB_IOC_SUBMIT, call with ff->lock held */
+static long fib_ioctl_submit(struct fib_file *ff, u64 __user *uarg)
+{
+    u64 n;
+
+    if (get_user(n, uarg))
+        return -EFAULT;
+    if (n > READ_ONCE(max_n))
+        return -EINVAL;
+    if (ff->job_state == FIB_JOB_PENDING)
+        return -EBUSY;
+    ff->job_n = n;
+    ff->job_format = ff->format;
+    WRITE_ONCE(ff->job_state, FIB_JOB_PENDING);
+    kref_get(&ff->ref);
+    queue_work(fib_wq, &ff->job);
+    return 0;
+}
+
+/*
+ * Packed records of FIB_IOC_RANGE and FIB_IOC_BATCH in a user buffer, every
+ * record is a __u64 byte count and then the bytes.
+ * [format] enum fib_format of the records
+ * [stage] kernel buffer to format raw and hex records in
+ * [buf], [len] the user buffer
+ * [written], [count] bytes and number of the whole records stored
+ * [required] bytes of all records put so far, an upper bound once [full]
+ * [full] a record did not fit, the later ones are only bounded
+ */
+struct fib_stream {
+    int format;
+    char *stage;
+    char __user *buf;
+    u64 len;
+    u64 written;
+    u64 count;
+    u64 required;
+    bool full;
+};
+
+/*
+ * @maxn: the largest index to be put
+ * Return 0 on success and -ENOMEM on failure.
+ */
+static int fib_stream_init(struct fib_stream *st,
+                           int format,
+                           u64 buf,
+                           u64 len,
+                           u64 maxn)
+{
+    /* hex is the longer of raw and hex */
+    size_t stage = (size_t) fbn_fib_cap(maxn) * sizeof(fbn_limb) * 2 + 1;
+
+    *st = (struct fib_stream){
+        .format = format,
+        .buf = u64_to_user_ptr(buf),
+        .len = len,
+    };
+    if (format == FIB_FMT_DEC)
+        return 0; /* fbn_printv1() gives the string */
+    st->stage = kvmalloc(stage, GFP_KERNEL);
+    return st->stage ? 0 : -ENOMEM;
+}
+
+static void fib_stream_destroy(struct fib_stream *st)
+{
+    kvfree(st->stage);
+}
+
+/*
+ * Upper bound of the bytes of the records of F(a..b) in @format. F(k) takes
+ * floor(k * num / den) + 1 bytes at most, by its k * log2(phi) bits or
+ * k * log10(phi) digits (log2(phi) = 0.69424..., log10(phi) = 0.20898...).
+ * Summed over the range, that is the value at the middle index plus one per
+ * record at most, besides the count of every record.
+ */
+static u64 fib_stream_bound(int format, u64 a, u64 b)
+{
+    u64 num = 20899, den = 100000;
+
+    if (format == FIB_FMT_RAW) {
+        num = 69425;
+        den = 800000;
+    } else if (format == FIB_FMT_HEX) {
+        num = 69425;
+        den = 400000;
+    }
+    return (b - a + 1) * (sizeof(u64) + (a + b) * num / (2 * den) + 2);
+}
+
+/*
+ * Append F(n) as a record. Once a record does not fit, F(n) is not rendered
+ * and only fib_stream_bound() of it is counted.
+ * Return 0 on success (also when it does not fit), -ENOMEM or -EFAULT on
+ * failure.
+ */
+static int fib_stream_put(struct fib_stream *st, const fbn *f, u64 n)
+{
+    char *rec = st->stage, *str = NULL;
+    u64 len;
+    int rc = 0;
+
+    if (st->full) {
+        st->required += fib_stream_bound(st->format, n, n);
+        return 0;
+    }
+    switch (st->format) {
+    case FIB_FMT_RAW:
+        len = fbn_raw_size(f);
+        break;
+    case FIB_FMT_HEX:
+        len = fbn_hex_size(f) - 1; /* without '\0' */
+        break;
+    default:
+        rec = str = fbn_printv1(f);
+        if (unlikely(!str))
+            return -ENOMEM;
+        len = strlen(str);
+        break;
+    }
+    st->required += sizeof(len) + len;
+    if (st->written + sizeof(len) + len > st->len) {
+        st->full = true;
+        goto out;
+    }
+    if (st->format == FIB_FMT_RAW)
+        fbn_to_raw(f, (u8 *) rec);
+    else if (st->format == FIB_FMT_HEX)
+        fbn_to_hex(f, rec);
+    if (copy_to_user(st->buf + st->written, &len, sizeof(len)) ||
+        copy_to_user(st->buf + st->written + sizeof(len), rec, len)) {
+        rc = -EFAULT;
+        goto out;
+    }
+    st->written += sizeof(len) + len;
+    ++st->count;
+out:
+    kvfree(str);
+    return rc;
+}
+
+/*
+ * FIB_IOC_RANGE: F(a) and F(a + 1) by fast doubling, then F(k + 2) =
+ * F(k) + F(k + 1) for the rest, until a record does not fit. The bits of a
+ * and then the records put are counted in ff->prog.
+ */
+static long fib_ioctl_range(struct fib_file *ff,
+                            struct fib_range_req __user *ureq)
+{
+    struct fib_range_req req;
+    struct fib_stream st;
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (req.version != FIB_REQ_VERSION || req.format >= FIB_FMT_NR ||
+        req.a > req.b || req.b > READ_ONCE(max_n))
+        return -EINVAL;
+
+    int cap = fbn_fib_cap(req.b + 1);
+    fbn *f0 = fbn_alloc(cap), *f1 = fbn_alloc(cap);
+    long rc = fib_stream_init(&st, req.format, req.buf, req.len, req.b);
+    if (unlikely(rc))
+        goto out;
+    rc = -ENOMEM;
+    if (unlikely(!f0 || !f1))
+        goto out;
+
+    ktime_t kt = ktime_get();
+    rc = fbn_fib_pair(f0, f1, req.a, &ff->prog);
+    if (unlikely(rc))
+        goto out;
+    fbn_fib_begin(&ff->prog, req.b, req.b - req.a + 1);
+    for (u64 k = req.a;; ++k) {
+        rc = fib_stream_put(&st, f0, k);
+        if (unlikely(rc))
+            goto out;
+        rc = fbn_fib_step(&ff->prog, k - req.a + 1);
+        if (unlikely(rc))
+            goto out;
+        if (k == req.b)
+            break;
+        if (st.full) {
+            /* the rest is not computed, only bounded */
+            st.required += fib_stream_bound(req.format, k + 1, req.b);
+            break;
+        }
+        rc = fbn_add(f0, f0, f1); /* F(k + 2) */
+        if (unlikely(rc))
+            goto out;
+        fbn *tmp = f0; /* f0 = F(k + 1), f1 = F(k + 2) */
+        f0 = f1;
+        f1 = tmp;
+    }
+    req.time_ns = ktime_to_ns(ktime_sub(ktime_get(), kt));
+    req.written = st.written;
+    req.count = st.count;
+    req.required = st.required;
+    rc = st.full ? -ENOSPC : 0;
+    if (copy_to_user(ureq, &req, sizeof(req)))
+        rc = -EFAULT;
+out:
+    fib_stream_destroy(&st);
+    fbn_free(f0);
+    fbn_free(f1);
+    return rc;
+}
+
+/* index and position in the caller's list of FIB_IOC_BATCH */
+struct fib_batch_ent {
+    u64 n;
+    int pos;
+};
+
+static int fib_batch_cmp(const void *a, const void *b)
+{
+    const struct fib_batch_ent *x = a, *y = b;
+    return (x->n > y->n) - (x->n < y->n);
+}
+
+/*
+ * FIB_IOC_BATCH: the indices are sorted and computed by fbn_fib_batch(),
+ * counted in ff->prog, then the records are put in the caller's order until
+ * one does not fit. Every result is held until then, so their capacities
+ * are limited to FIB_BATCH_MAX_BYTES together.
+ */
+static long fib_ioctl_batch(struct fib_file *ff,
+                            struct fib_batch_req __user *ureq)
+{
+    struct fib_batch_req req;
+    struct fib_stream st = {0};
+
+    if (copy_from_user(&req, ureq, sizeof(req)))
+        return -EFAULT;
+    if (req.version != FIB_REQ_VERSION || req.format >= FIB_FMT_NR ||
+        req.reserved || !req.count || req.count > FIB_BATCH_MAX)
+        return -EINVAL;
+
+    u32 cnt = req.count;
+    u64 *idx = kvmalloc_array(cnt, sizeof(*idx), GFP_KERNEL);
+    struct fib_batch_ent *ent = kvmalloc_array(cnt, sizeof(*ent), GFP_KERNEL);
+    u64 *sorted = kvmalloc_array(cnt, sizeof(*sorted), GFP_KERNEL);
+    /* the results in the caller's order, then in ascending order */
+    fbn **res = kvcalloc(2 * cnt, sizeof(*res), GFP_KERNEL);
+    long rc = -ENOMEM;
+    if (unlikely(!idx || !ent || !sorted || !res))
+        goto out;
+    rc = -EFAULT;
+    if (copy_from_user(idx, u64_to_user_ptr(req.idx), cnt * sizeof(*idx)))
+        goto out;
+    rc = -EINVAL;
+    u64 maxn = READ_ONCE(max_n), bytes = 0;
+    for (u32 i = 0; i < cnt; ++i) {
+        if (idx[i] > maxn)
+            goto out;
+        ent[i].n = idx[i];
+        ent[i].pos = i;
+        bytes += (u64) fbn_fib_cap(idx[i]) * sizeof(fbn_limb);
+    }
+    rc = -E2BIG;
+    if (bytes > FIB_BATCH_MAX_BYTES)
+        goto out;
+    sort(ent, cnt, sizeof(*ent), fib_batch_cmp, NULL);
+    rc = fib_stream_init(&st, req.format, req.buf, req.len, ent[cnt - 1].n);
+    if (unlikely(rc))
+        goto out;
+    rc = -ENOMEM;
+    for (u32 i = 0; i < cnt; ++i) {
+        res[i] = fbn_alloc(1);
+        if (unlikely(!res[i]))
+            goto out;
+    }
+    for (u32 i = 0; i < cnt; ++i) {
+        sorted[i] = ent[i].n;
+        res[cnt + i] = res[ent[i].pos];
+    }
+
+    struct fbn_batch_stats stats;
+    ktime_t kt = ktime_get();
+    rc = fbn_fib_batch(res + cnt, sorted, cnt, &stats, &ff->prog);
+    if (unlikely(rc))
+        goto out;
+    for (u32 i = 0; i < cnt; ++i) {
+        rc = fib_stream_put(&st, res[i], idx[i]);
+        if (unlikely(rc))
+            goto out;
+        /* a large decimal record takes long to render */
+        rc = fbn_fib_step(NULL, 0);
+        if (unlikely(rc))
+            goto out;
+    }
+    req.time_ns = ktime_to_ns(ktime_sub(ktime_get(), kt));
+    req.written = st.written;
+    req.stored = st.count;
+    req.required = st.required;
+    req.nrestart = stats.nrestart;
+    req.nstep = stats.nstep;
+    req.njump = stats.njump;
+    req.cost = stats.cost;
+    req.cost_restart = stats.cost_restart;
+    pr_debug("fibdrv: batch of %u: restart %llu step %llu jump %llu, "
+             "cost %llu (restart all %llu)\n",
+             cnt, stats.nrestart, stats.nstep, stats.njump, stats.cost,
+             stats.cost_restart);
+    rc = st.full ? -ENOSPC : 0;
+    if (copy_to_user(ureq, &req, sizeof(req)))
+        rc = -EFAULT;
+out:
+    fib_stream_destroy(&st);
+    for (u32 i = 0; res && i < cnt; ++i)
+        fbn_free(res[i]);
+    kvfree(res);
+    kvfree(sorted);
+    kvfree(ent);
+    kvfree(idx);
+    return rc;
+}
+
+static long fib_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct fib_file *ff = file->private_data;
+    u64 __user *uarg = (u64 __user *) arg;
+    u64 n;
+    long rc;
+
+    if (cmd == FIB_IOC_GET_PROGRESS)
+        return fib_ioctl_progress(ff, (struct fib_progress __user *) arg);
+    mutex_lock(&ff->lock);
+    switch (cmd) {
+    case FIB_IOC_SET_FORMAT:
+        rc = -EINVAL;
+        if (arg >= FIB_FMT_NR)
+            break;
+        if (ff->format != arg) {
+            ff->format = arg;
+            ff->out_len = 0;
+        }
+        rc = 0;
+        break;
+    case FIB_IOC_SET_SEQ:
+        rc = -EINVAL;
+        if (arg > 1)
+            break;
+        ff->seq = arg;
+        rc = 0;
+        break;
+    case FIB_IOC_GET_SIZE:
+        rc = fib_render(ff, file->f_pos, ff->format, FIB_ENG_FASTDBLv1);
+        if (likely(!rc))
+            rc = put_user((u64) ff->out_len, uarg);
+        break;
+    case FIB_IOC_COMPUTE:
+        rc = -EFAULT;
+        if (get_user(n, uarg))
+            break;
+        rc = -EINVAL;
+        if (n > READ_ONCE(max_n))
+            break;
+        rc = fib_render(ff, n, ff->format, FIB_ENG_FASTDBLv1);
+        if (likely(!rc))
+            rc = put_user((u64) ff->out_len, uarg);
+        break;
+    case FIB_IOC_REQUEST:
+        rc = fib_ioctl_request(ff, (struct fib_req __user *) arg);
+        break;
+    case FIB_IOC_RANGE:
+        rc = fib_ioctl_range(ff, (struct fib_range_req __user *) arg);
+        break;
+    case FIB_IOC_BATCH:
+        rc = fib_ioctl_batch(ff, (struct fib_batch_req __user *) arg);
+        break;
+    case FIB_IOC_SUBMIT:
+        rc = fib_ioctl_submit(ff, uarg);
+        break;
+    default:
+        rc = -ENOTTY;
+        break;
+    }
+    mutex_unlock(&ff->lock);
+    return rc;
+}
+
+/* Readable unless a job of FIB_IOC_SUBMIT is still pending */
+static __poll_t fib_poll(struct file *file, poll_table *wait)
+{
+    struct fib_file *ff = file->private_data;
+
+    poll_wait(file, &ff->wait, wait);
+    if (READ_ONCE(ff->job_state) == FIB_JOB_PENDING)
+        return 0;
+    return EPOLLIN | EPOLLRDNORM;
+}
+
+/* Map the result region read-only, FIB_IOC_COMPUTE fills it */
+static int fib_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct fib_file *ff = file->private_data;
+    int rc = -EPERM;
+
+    if (vma->vm_flags & VM_WRITE)
+        return rc;
+    /* nor can mprotect() make it writable later */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    mutex_lock(&ff->lock);
+    rc = -ENODATA;
+    if (ff->out_len)
+        rc = remap_vmalloc_range(vma, ff->out, vma->vm_pgoff);
+    mutex_unlock(&ff->lock);
+    return rc;
+}
+
+/* One line per open file: pid, the last index computed, steps done/total */
+static int fib_progress_show(struct seq_file *m, void *v)
+{
+    struct fib_file *ff;
+
+    mutex_lock(&fib_files_lock);
+    list_for_each_entry (ff, &fib_files, node) {
+        seq_printf(m, "%d %llu %llu/%llu\n", ff->pid,
+                   (unsigned long long) READ_ONCE(ff->prog.n),
+                   (unsigned long long) READ_ONCE(ff->prog.done),
+                   (unsigned long long) READ_ONCE(ff->prog.total));
+    }
+    mutex_unlock(&fib_files_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fib_progress);
+
 const struct file_operations fib_fops = {
     .owner = THIS_MODULE,
     .read = fib_read,
@@ -363,13 +1511,32 @@ const struct file_operations fib_fops = {
     .open = fib_open,
     .release = fib_release,
     .llseek = fib_device_lseek,
+    .unlocked_ioctl = fib_ioctl,
+    .mmap = fib_mmap,
+    .poll = fib_poll,
 };
 
 static int __init init_fib_dev(void)
 {
     int rc = 0;
 
-    mutex_init(&fib_mutex);
+    /* dec_dc_threshold may be set after max_n and enlarge the arenas */
+    if (max_n > fbn_arena_max_n()) {
+        max_n = fbn_arena_max_n();
+        pr_warn("fibdrv: max_n lowered to %llu\n", max_n);
+    }
+
+    /* before the device shows up, so every read sees the whole table */
+    if (precompute && fib_table_init())
+        pr_warn("fibdrv: no memory to precompute, computing on demand\n");
+
+    fib_wq = alloc_workqueue("fibdrv", WQ_UNBOUND, 0);
+    if (!fib_wq) {
+        fib_table_free();
+        return -ENOMEM;
+    }
+    if (fbn_wq_init())
+        pr_warn("fibdrv: no workqueue, computing on one CPU per request\n");
 
     // Let's register the device
     // This will dynamically allocate the major number
@@ -379,6 +1546,9 @@ static int __init init_fib_dev(void)
         printk(KERN_ALERT
                "Failed to register the fibonacci char device. rc = %i",
                rc);
+        destroy_workqueue(fib_wq);
+        fbn_wq_destroy();
+        fib_table_free();
         return rc;
     }
 
@@ -397,7 +1567,11 @@ static int __init init_fib_dev(void)
         goto failed_cdev;
     }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    fib_class = class_create(DEV_FIBONACCI_NAME);
+#else
     fib_class = class_create(THIS_MODULE, DEV_FIBONACCI_NAME);
+#endif
 
     if (!fib_class) {
         printk(KERN_ALERT "Failed to create device class");
@@ -405,11 +1579,16 @@ static int __init init_fib_dev(void)
         goto failed_class_create;
     }
 
-    if (!device_create(fib_class, NULL, fib_dev, NULL, DEV_FIBONACCI_NAME)) {
+    if (!device_create_with_groups(fib_class, NULL, fib_dev, NULL,
+                                   fib_cache_groups, DEV_FIBONACCI_NAME)) {
         printk(KERN_ALERT "Failed to create device");
         rc = -4;
         goto failed_device_create;
     }
+    /* optional, the device works without it */
+    fib_debugfs = debugfs_create_dir(DEV_FIBONACCI_NAME, NULL);
+    debugfs_create_file("progress", 0444, fib_debugfs, NULL,
+                        &fib_progress_fops);
     return rc;
 failed_device_create:
     class_destroy(fib_class);
@@ -417,16 +1596,27 @@ failed_class_create:
     cdev_del(fib_cdev);
 failed_cdev:
     unregister_chrdev_region(fib_dev, 1);
+    destroy_workqueue(fib_wq);
+    fbn_wq_destroy();
+    fib_table_free();
     return rc;
 }
 
 static void __exit exit_fib_dev(void)
 {
-    mutex_destroy(&fib_mutex);
+    debugfs_remove_recursive(fib_debugfs);
     device_destroy(fib_class, fib_dev);
     class_destroy(fib_class);
     cdev_del(fib_cdev);
     unregister_chrdev_region(fib_dev, 1);
+    /* the jobs of closed files may still run */
+    destroy_workqueue(fib_wq);
+    fbn_wq_destroy();
+    fib_cache_clear();
+    fib_table_free();
+    fbn_ckpt_free();
+    fbn_scratch_free();
+    fbn_dec_pow_free();
 }
 
 module_init(init_fib_dev);
@@ -0,0 +1,260 @@
+#ifndef __FIBDRV_H_
+#define __FIBDRV_H_
+
+/*
+ * Interface of /dev/fibonacci shared by the module and user programs.
+ */
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Output format of read(), selected per open file by FIB_IOC_SET_FORMAT.
+ *
+ * [FIB_FMT_DEC] decimal string with '\0', read(fd, buf, method) selects the
+ *               engine by its size argument (default). Having no buffer size,
+ *               it fails with -EOVERFLOW beyond F(10000), use FIB_IOC_REQUEST
+ *               for larger n
+ * [FIB_FMT_RAW] little-endian bytes of F(n) without leading zero bytes,
+ *               read(fd, buf, size) returns the bytes copied
+ * [FIB_FMT_HEX] lowercase hex string with '\0', read(fd, buf, size) returns
+ *               the bytes copied including the '\0'
+ *
+ * In raw and hex formats the binary fast doubling engine is used and a read
+ * with a buffer smaller than the result fails with -EOVERFLOW. The result
+ * stays in the open file, so FIB_IOC_GET_SIZE and reads of the same offset
+ * do not compute again.
+ *
+ * Sequential mode (FIB_IOC_SET_SEQ): read(fd, buf, size) returns F(f_pos) in
+ * the current format and advances f_pos, so consecutive reads scan forward
+ * with one addition each. The open file keeps the last two numbers, a read
+ * after lseek() to anywhere else computes them again. It returns 0 once
+ * f_pos is past the largest offset, and fails with -EOVERFLOW if the buffer
+ * is too small.
+ *
+ * Offsets and the indices of the ioctls go up to the max_n parameter of the
+ * module (/sys/module/fibdrv_bn/parameters/max_n), lseek() stops there and
+ * larger indices fail with -EINVAL. One computation works in an arena of at
+ * most 2 GiB, which limits max_n to about 6.3e8 (3.6e8 with 32-bit limbs),
+ * i.e. 130 MB in decimal and 55 MB in raw format. Sizes are 64-bit.
+ *
+ * Zero-copy: FIB_IOC_COMPUTE writes F(n) in the current format (any of
+ * them, the decimal one included) into a result region of the open file,
+ * which is mapped by mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0). The
+ * region is rewritten in place by the next FIB_IOC_COMPUTE, map it again if
+ * the new size is larger than the mapping.
+ *
+ * Asynchronous mode: FIB_IOC_SUBMIT queues F(n) in the current format to a
+ * kernel worker and returns at once. poll() reports EPOLLIN once the result
+ * is ready, and read(fd, buf, size) returns it (whatever the format, @size
+ * is the length of @buf) and ends the job. With O_NONBLOCK the read fails
+ * with -EAGAIN while the job is pending, otherwise it waits. A buffer too
+ * small fails with -EOVERFLOW and keeps the result. close() drops a job not
+ * started yet and never waits for a running one. Other requests on the same
+ * open file wait for a running job, so drive each job on its own open file.
+ *
+ * Long computations yield the CPU between their steps and stop with -EINTR
+ * when the caller gets a fatal signal, or when the file of a job is closed.
+ * FIB_IOC_GET_PROGRESS tells how far the last computation of an open file
+ * went, without waiting for it. /sys/kernel/debug/fibonacci/progress lists
+ * every open file as "pid n done/total".
+ */
+enum fib_format {
+    FIB_FMT_DEC,
+    FIB_FMT_RAW,
+    FIB_FMT_HEX,
+    FIB_FMT_NR,
+};
+
+/*
+ * Big number Fibonacci engines, the method of the decimal read().
+ * [FIB_ENG_DEC] computes in decimal limbs, so only FIB_FMT_DEC is available
+ */
+enum fib_engine {
+    FIB_ENG_DEFI,
+    FIB_ENG_FASTDBL,
+    FIB_ENG_FASTDBLv1,
+    FIB_ENG_DEC,
+    FIB_ENG_NR,
+};
+
+#define FIB_REQ_VERSION 1
+
+/*
+ * Request of FIB_IOC_REQUEST, all fields are 64-bit aligned so the layout is
+ * the same for 32-bit and 64-bit user space.
+ *
+ * Filled by the caller:
+ * [version] FIB_REQ_VERSION
+ * [engine] enum fib_engine
+ * [format] enum fib_format
+ * [n] which Fibonacci number
+ * [buf] user buffer to store F(n), cast from a pointer
+ * [len] bytes of [buf]
+ *
+ * Filled by the driver (also on -ENOSPC):
+ * [written] bytes stored to [buf], 0 if it is too small
+ * [required] bytes F(n) takes in [format]
+ * [time_ns] time of the engine computing F(n), excluding the formatting, 0
+ *           if F(n) came from the result cache of the driver
+ */
+struct fib_req {
+    __u32 version;
+    __u32 engine;
+    __u32 format;
+    __u32 reserved;
+    __u64 n;
+    __u64 buf;
+    __u64 len;
+    __u64 written;
+    __u64 required;
+    __u64 time_ns;
+};
+
+/*
+ * Request of FIB_IOC_RANGE for F(a), F(a + 1), ..., F(b).
+ *
+ * The records are packed into [buf] one after another without padding, each
+ * record is a __u64 byte count (host byte order) followed by that many bytes
+ * of F(k) in [format], without the '\0' of the string formats.
+ *
+ * Filled by the caller:
+ * [version] FIB_REQ_VERSION
+ * [format] enum fib_format
+ * [a], [b] the range, a <= b
+ * [buf] user buffer to store the records, cast from a pointer
+ * [len] bytes of [buf]
+ *
+ * Filled by the driver (also on -ENOSPC):
+ * [written] bytes of the whole records stored to [buf]
+ * [count] number of the whole records stored to [buf]
+ * [required] bytes of all records of the range. On -ENOSPC it is exact up
+ *            to the first record which does not fit, and an upper bound of
+ *            the later ones, which are neither computed nor formatted
+ * [time_ns] time of computing and formatting the range
+ */
+struct fib_range_req {
+    __u32 version;
+    __u32 format;
+    __u64 a;
+    __u64 b;
+    __u64 buf;
+    __u64 len;
+    __u64 written;
+    __u64 count;
+    __u64 required;
+    __u64 time_ns;
+};
+
+/* Most indices of one FIB_IOC_BATCH */
+#define FIB_BATCH_MAX 1024
+/*
+ * Most bytes of the results one FIB_IOC_BATCH holds until they are packed,
+ * F(n) takes about n / 11 of them
+ */
+#define FIB_BATCH_MAX_BYTES (256U << 20)
+
+/*
+ * Request of FIB_IOC_BATCH for F(idx[0]), F(idx[1]), ... in any order, the
+ * records are packed like FIB_IOC_RANGE in the order of [idx].
+ *
+ * Filled by the caller:
+ * [version] FIB_REQ_VERSION
+ * [format] enum fib_format
+ * [count] number of the indices, 1 to FIB_BATCH_MAX
+ * [reserved] 0
+ * [idx] user array of [count] __u64 indices, cast from a pointer
+ * [buf] user buffer to store the records, cast from a pointer
+ * [len] bytes of [buf]
+ *
+ * Filled by the driver (also on -ENOSPC):
+ * [written] bytes of the whole records stored to [buf]
+ * [stored] number of the whole records stored to [buf]
+ * [required] bytes of all records, on -ENOSPC an upper bound like
+ *            FIB_IOC_RANGE: the records after the first one which does not
+ *            fit are not formatted
+ * [time_ns] time of computing and formatting the batch
+ * [nrestart], [nstep], [njump] how many indices were computed from scratch,
+ *                              by additions or by the addition formula from
+ *                              the next smaller index
+ * [cost], [cost_restart] estimated cost of the ways taken and of computing
+ *                        every index from scratch
+ */
+struct fib_batch_req {
+    __u32 version;
+    __u32 format;
+    __u32 count;
+    __u32 reserved;
+    __u64 idx;
+    __u64 buf;
+    __u64 len;
+    __u64 written;
+    __u64 stored;
+    __u64 required;
+    __u64 time_ns;
+    __u64 nrestart;
+    __u64 nstep;
+    __u64 njump;
+    __u64 cost;
+    __u64 cost_restart;
+};
+
+/*
+ * Progress of the last computation of an open file, from FIB_IOC_GET_PROGRESS.
+ * [n] the index, the largest one of FIB_IOC_RANGE and FIB_IOC_BATCH
+ * [done], [total] steps taken and to take: bits of n for the fast doubling
+ *                 engines, additions for FIB_ENG_DEFI, records put by
+ *                 FIB_IOC_RANGE (after the bits of a) and indices computed
+ *                 by FIB_IOC_BATCH. Equal once it is over, unless
+ *                 FIB_IOC_RANGE stopped at a record which does not fit
+ */
+struct fib_progress {
+    __u64 n;
+    __u64 done;
+    __u64 total;
+};
+
+#define FIB_IOC_MAGIC 'f'
+/* Select the output format of read(), the argument is enum fib_format */
+#define FIB_IOC_SET_FORMAT _IO(FIB_IOC_MAGIC, 0)
+/* Enter (argument 1) or leave (argument 0) the sequential mode of read() */
+#define FIB_IOC_SET_SEQ _IO(FIB_IOC_MAGIC, 6)
+/* Exact bytes read() needs for F(offset) in the current format */
+#define FIB_IOC_GET_SIZE _IOR(FIB_IOC_MAGIC, 1, __u64)
+/*
+ * Compute F(n) into the result region, the argument points to n on input and
+ * receives the bytes of the result on output
+ */
+#define FIB_IOC_COMPUTE _IOWR(FIB_IOC_MAGIC, 2, __u64)
+/*
+ * Compute F(n) by the engine and copy it to the buffer of struct fib_req.
+ * Fail with -ENOSPC and [required] set if the buffer is too small, the result
+ * is kept so asking again with a larger buffer does not compute again.
+ * Fail with -EINVAL on an unknown version, engine or format, a nonzero
+ * [reserved] or n out of range.
+ */
+#define FIB_IOC_REQUEST _IOWR(FIB_IOC_MAGIC, 3, struct fib_req)
+/*
+ * Compute F(a..b) of struct fib_range_req: F(a) and F(a + 1) by fast doubling,
+ * the others by one addition each. Fail with -ENOSPC if [buf] cannot hold
+ * every record, the records which fit are stored still, so the rest can be
+ * asked from F(a + count) on.
+ */
+#define FIB_IOC_RANGE _IOWR(FIB_IOC_MAGIC, 4, struct fib_range_req)
+/*
+ * Compute F(n) for every index of struct fib_batch_req, walking up the
+ * sorted indices. Fail with -ENOSPC like FIB_IOC_RANGE, and with -E2BIG if
+ * the results together pass FIB_BATCH_MAX_BYTES.
+ */
+#define FIB_IOC_BATCH _IOWR(FIB_IOC_MAGIC, 5, struct fib_batch_req)
+/*
+ * Queue F(n) in the current format, the argument points to n. Fail with
+ * -EBUSY while the previous job of the open file is pending.
+ */
+#define FIB_IOC_SUBMIT _IOW(FIB_IOC_MAGIC, 7, __u64)
+/*
+ * Copy the progress of the last computation of the open file to struct
+ * fib_progress, from another thread while it runs or at any time
+ */
+#define FIB_IOC_GET_PROGRESS _IOR(FIB_IOC_MAGIC, 8, struct fib_progress)
+
+#endif /* __FIBDRV_H_ */